@@ -13,6 +13,11 @@
 // * Only one process at a time can use a buffer,
 //     so do not keep them longer than necessary.
 //
+// Buffers come from a slab cache.  The cache holds about NBUF
+// buffers; bget() allocates an extra one rather than wait when
+// every buffer is busy or dirty, and brelse() frees clean
+// buffers again while there are more than NBUF.
+//
 // The implementation uses three state flags internally:
 // * B_BUSY: the block has been returned from bread
 //     and has not been passed back to brelse.
@@ -25,10 +30,12 @@
 #include "param.h"
 #include "spinlock.h"
 #include "buf.h"
+#include "slab.h"
 
 struct {
   struct spinlock lock;
-  struct buf buf[NBUF];
+  struct slabcache slab;
+  int n;            // number of buffers allocated
 
   // Linked list of all buffers, through prev/next.
   // head.next is most recently used.
@@ -38,21 +45,13 @@ struct {
 void
 binit(void)
 {
-  struct buf *b;
-
   initlock(&bcache.lock, "bcache");
+  slabinit(&bcache.slab, "buf", sizeof(struct buf));
 
 //PAGEBREAK!
   // Create linked list of buffers
   bcache.head.prev = &bcache.head;
   bcache.head.next = &bcache.head;
-  for(b = bcache.buf; b < bcache.buf+NBUF; b++){
-    b->next = bcache.head.next;
-    b->prev = &bcache.head;
-    b->dev = -1;
-    bcache.head.next->prev = b;
-    bcache.head.next = b;
-  }
 }
 
 // Look through buffer cache for sector on device dev.
@@ -79,17 +78,33 @@ bget(uint dev, uint sector)
     }
   }
 
-  // Not cached; recycle some non-busy and clean buffer.
-  for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
-    if((b->flags & B_BUSY) == 0 && (b->flags & B_DIRTY) == 0){
-      b->dev = dev;
-      b->sector = sector;
-      b->flags = B_BUSY;
-      release(&bcache.lock);
-      return b;
+  // Not cached; recycle some non-busy and clean buffer,
+  // unless the cache has not yet grown to NBUF buffers.
+  if(bcache.n >= NBUF){
+    for(b = bcache.head.prev; b != &bcache.head; b = b->prev){
+      if((b->flags & B_BUSY) == 0 && (b->flags & B_DIRTY) == 0){
+        b->dev = dev;
+        b->sector = sector;
+        b->flags = B_BUSY;
+        release(&bcache.lock);
+        return b;
+      }
     }
   }
-  panic("bget: no buffers");
+
+  // Allocate another buffer.
+  if((b = slaballoc(&bcache.slab)) == 0)
+    panic("bget: no buffers");
+  bcache.n++;
+  b->dev = dev;
+  b->sector = sector;
+  b->flags = B_BUSY;
+  b->next = bcache.head.next;
+  b->prev = &bcache.head;
+  bcache.head.next->prev = b;
+  bcache.head.next = b;
+  release(&bcache.lock);
+  return b;
 }
 
 // Return a B_BUSY buf with the contents of the indicated disk sector.
@@ -115,7 +130,8 @@ bwrite(struct buf *b)
 }
 
 // Release a B_BUSY buffer.
-// Move to the head of the MRU list.
+// Move to the head of the MRU list, or free it if it is
+// clean and the cache has grown past NBUF buffers.
 void
 brelse(struct buf *b)
 {
@@ -126,6 +142,13 @@ brelse(struct buf *b)
 
   b->next->prev = b->prev;
   b->prev->next = b->next;
+  if(bcache.n > NBUF && (b->flags & B_DIRTY) == 0){
+    bcache.n--;
+    wakeup(b);
+    release(&bcache.lock);
+    slabfree(&bcache.slab, b);
+    return;
+  }
   b->next = bcache.head.next;
   b->prev = &bcache.head;
   bcache.head.next->prev = b;
@@ -1,9 +1,14 @@
 struct buf;
 struct context;
+struct direntplus;
 struct file;
 struct inode;
+struct iovec;
+struct lockstat;
 struct pipe;
+struct vma;
 struct proc;
+struct slabcache;
 struct spinlock;
 struct stat;
 struct superblock;
@@ -28,9 +33,17 @@ int             exec(char*, char**);
 // file.c
 struct file*    filealloc(void);
 void            fileclose(struct file*);
+int             filecopy(struct file*, struct file*, int n);
 struct file*    filedup(struct file*);
 void            fileinit(void);
 int             fileread(struct file*, char*, int n);
+int             filereaddir(struct file*, struct direntplus*, int n);
+int             filereadv(struct file*, struct iovec*, int);
+int             filewritev(struct file*, struct iovec*, int);
+int             filepread(struct file*, char*, int n, uint off);
+int             filepwrite(struct file*, char*, int n, uint off);
+int             fileseek(struct file*, int off, int whence);
+int             filesplice(struct file*, struct file*, int n);
 int             filestat(struct file*, struct stat*);
 int             filewrite(struct file*, char*, int n);
 
@@ -48,10 +61,15 @@ void            iunlockput(struct inode*);
 void            iupdate(struct inode*);
 int             namecmp(const char*, const char*);
 struct inode*   namei(char*);
+struct inode*   nameiat(struct inode*, char*);
 struct inode*   nameiparent(char*, char*);
+struct inode*   nameiparentat(struct inode*, char*, char*);
 int             readi(struct inode*, char*, uint, uint);
+int             readdiri(struct inode*, struct direntplus*, uint*, int);
 void            stati(struct inode*, struct stat*);
 int             writei(struct inode*, char*, uint, uint);
+int             readipipe(struct inode*, struct pipe*, uint, uint);
+int             writeipipe(struct inode*, struct pipe*, uint, uint);
 //A&T
 int             fs_ftag(struct file*, char*, char*);
 int             fs_funtag(struct file*, char*);
@@ -69,7 +87,11 @@ void            ioapicinit(void);
 
 // kalloc.c
 char*           kalloc(void);
+char*           kalloc_zeroed(void);
+int             kzero(void);
 void            kfree(char*);
+void            kref(char*);
+int             krefcount(char*);
 void            kinit1(void*, void*);
 void            kinit2(void*, void*);
 
@@ -82,6 +104,8 @@ extern volatile uint*    lapic;
 void            lapiceoi(void);
 void            lapicinit(int);
 void            lapicstartap(uchar, uint);
+void            lapictimer(int);
+void            lapicwakeup(uchar);
 void            microdelay(int);
 
 // log.c
@@ -90,6 +114,19 @@ void            log_write(struct buf*);
 void            begin_trans();
 void            commit_trans();
 
+// mmap.c
+int             mmap(struct file*, int, int, int, int);
+int             munmap(uint, int);
+void            mmapclear(struct proc*);
+void            mmapfork(struct proc*, struct proc*);
+void            pcacheinit(void);
+void            pcacheinval(uint, uint);
+void            pcachewrite(struct inode*, uint, uint);
+int             mmapfault(struct proc*, struct vma*, uint, uint);
+struct vma*     findvma(struct proc*, uint);
+uint            mmaplimit(struct proc*);
+int             mmapvalid(struct proc*, uint, uint);
+
 // mp.c
 extern int      ismp;
 int             mpbcpu(void);
@@ -104,7 +141,12 @@ void            picinit(void);
 int             pipealloc(struct file**, struct file**);
 void            pipeclose(struct pipe*, int);
 int             piperead(struct pipe*, char*, int);
+int             pipereadv(struct pipe*, struct iovec*, int);
 int             pipewrite(struct pipe*, char*, int);
+int             pipewaitwrite(struct pipe*);
+int             pipewaitread(struct pipe*);
+int             pipeput(struct pipe*, char*, int);
+int             pipeget(struct pipe*, char*, int);
 
 //PAGEBREAK: 16
 // proc.c
@@ -117,6 +159,8 @@ void            pinit(void);
 void            procdump(void);
 void            scheduler(void) __attribute__((noreturn));
 void            sched(void);
+int             setaffinity(int, uint);
+int             setpriority(int, int);
 void            sleep(void*, struct spinlock*);
 void            userinit(void);
 int             wait(void);
@@ -126,11 +170,17 @@ void            yield(void);
 // swtch.S
 void            swtch(struct context**, struct context*);
 
+// slab.c
+void            slabinit(struct slabcache*, char*, uint);
+void*           slaballoc(struct slabcache*);
+void            slabfree(struct slabcache*, void*);
+
 // spinlock.c
 void            acquire(struct spinlock*);
 void            getcallerpcs(void*, uint*);
 int             holding(struct spinlock*);
 void            initlock(struct spinlock*, char*);
+int             lockstat(struct lockstat*, int);
 void            release(struct spinlock*);
 void            pushcli(void);
 void            popcli(void);
@@ -146,8 +196,9 @@ char*           strncpy(char*, const char*, int);
 
 // syscall.c
 int             argint(int, int*);
-int             argptr(int, char**, int);
+int             argptr(int, char**, int, int);
 int             argstr(int, char**);
+int             checkrange(uint, uint, int);
 int             fetchint(struct proc*, uint, int*);
 int             fetchstr(struct proc*, uint, char**);
 void            syscall(void);
@@ -176,8 +227,11 @@ int             allocuvm(pde_t*, uint, uint);
 int             deallocuvm(pde_t*, uint, uint);
 void            freevm(pde_t*);
 void            inituvm(pde_t*, char*, uint);
-int             loaduvm(pde_t*, char*, struct inode*, uint, uint);
-pde_t*          copyuvm(pde_t*, uint);
+pde_t*          copyuvm(pde_t*);
+pte_t*          walkpgdir(pde_t*, const void*, int);
+int             mappages(pde_t*, void*, uint, uint, int);
+int             pagefault(uint, uint);
+int             prefault(uint, uint, int);
 void            switchuvm(struct proc*);
 void            switchkvm(void);
 int             copyout(pde_t*, uint, void*, uint);
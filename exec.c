@@ -6,8 +6,10 @@
 #include "defs.h"
 #include "x86.h"
 #include "elf.h"
-
-#define I_SYMLNK 0x3
+#include "stat.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
 
 int
 exec(char *path, char **argv)
@@ -19,6 +21,8 @@ exec(char *path, char **argv)
   struct inode *ip;
   struct proghdr ph;
   pde_t *pgdir, *oldpgdir;
+  struct file *f;
+  struct vma seg[NVMA], *v;
   char tmp_path[MAX_LNK_NAME];		/* A&T */
 
   /* A&T use readlink to de-reference symbolic links  */
@@ -53,6 +57,8 @@ exec(char *path, char **argv)
   //A&T - end
 
   pgdir = 0;
+  f = 0;
+  memset(seg, 0, sizeof(seg));
 
   // Check ELF header
   if(readi(ip, (char*)&elf, 0, sizeof(elf)) < sizeof(elf))
@@ -63,22 +69,46 @@ exec(char *path, char **argv)
   if((pgdir = setupkvm(kalloc)) == 0)
     goto bad;
 
-  // Load program into memory.
+  // The program is not loaded here.  Each segment becomes a
+  // private mapping of the file, and pagefault() reads its
+  // pages in as they are first used.
+  if((f = filealloc()) == 0)
+    goto bad;
+  f->type = FD_INODE;
+  f->ip = idup(ip);
+  f->off = 0;
+  f->readable = 1;
+  f->writable = 0;
+  // Writes to the file fail until the last mapping is gone.
+  f->text = 1;
+  ip->ntext++;
   sz = 0;
+  v = seg;
   for(i=0, off=elf.phoff; i<elf.phnum; i++, off+=sizeof(ph)){
     if(readi(ip, (char*)&ph, off, sizeof(ph)) != sizeof(ph))
       goto bad;
     if(ph.type != ELF_PROG_LOAD)
       continue;
-    if(ph.memsz < ph.filesz)
+    if(ph.memsz < ph.filesz || ph.vaddr + ph.memsz < ph.vaddr)
       goto bad;
-    if((sz = allocuvm(pgdir, sz, ph.vaddr + ph.memsz)) == 0)
+    if(ph.vaddr % PGSIZE || ph.vaddr < sz || ph.vaddr + ph.memsz >= KERNBASE)
       goto bad;
-    if(loaduvm(pgdir, (char*)ph.vaddr, ip, ph.off, ph.filesz) < 0)
+    if(v == &seg[NVMA])
       goto bad;
+    v->addr = ph.vaddr;
+    v->len = PGROUNDUP(ph.memsz);
+    v->off = ph.off;
+    v->flen = ph.filesz;
+    v->prot = PROT_READ|PROT_WRITE;
+    v->flags = MAP_PRIVATE;
+    v->f = filedup(f);
+    v++;
+    sz = ph.vaddr + ph.memsz;
   }
   iunlockput(ip);
   ip = 0;
+  fileclose(f);
+  f = 0;
 
   // Allocate two pages at the next page boundary.
   // Make the first inaccessible.  Use the second as the user stack.
@@ -114,6 +144,8 @@ exec(char *path, char **argv)
   safestrcpy(proc->name, last, sizeof(proc->name));
 
   // Commit to the user image.
+  mmapclear(proc);
+  memmove(proc->vma, seg, sizeof(seg));
   oldpgdir = proc->pgdir;
   proc->pgdir = pgdir;
   proc->sz = sz;
@@ -128,5 +160,10 @@ exec(char *path, char **argv)
     freevm(pgdir);
   if(ip)
     iunlockput(ip);
+  if(f)
+    fileclose(f);
+  for(v = seg; v < &seg[NVMA]; v++)
+    if(v->f)
+      fileclose(v->f);
   return -1;
 }
@@ -2,3 +2,22 @@
 #define O_WRONLY  0x001
 #define O_RDWR    0x002
 #define O_CREATE  0x200
+
+// One buffer of a readv/writev request.
+struct iovec {
+  void *iov_base;
+  int iov_len;
+};
+
+// mmap prot
+#define PROT_READ   0x1
+#define PROT_WRITE  0x2
+
+// mmap flags
+#define MAP_SHARED  0x1   // writes go back to the file
+#define MAP_PRIVATE 0x2   // writes stay in this process
+
+// lseek whence
+#define SEEK_SET  0
+#define SEEK_CUR  1
+#define SEEK_END  2
@@ -5,38 +5,39 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "mmu.h"
+#include "stat.h"
 #include "fs.h"
 #include "file.h"
+#include "fcntl.h"
 #include "spinlock.h"
+#include "slab.h"
 
 struct devsw devsw[NDEV];
 struct {
   struct spinlock lock;
-  struct file file[NFILE];
+  struct slabcache slab;
 } ftable;
 
 void
 fileinit(void)
 {
   initlock(&ftable.lock, "ftable");
+  slabinit(&ftable.slab, "file", sizeof(struct file));
 }
 
 // Allocate a file structure.
+// Returns 0 if there is no memory.
 struct file*
 filealloc(void)
 {
   struct file *f;
 
-  acquire(&ftable.lock);
-  for(f = ftable.file; f < ftable.file + NFILE; f++){
-    if(f->ref == 0){
-      f->ref = 1;
-      release(&ftable.lock);
-      return f;
-    }
-  }
-  release(&ftable.lock);
-  return 0;
+  if((f = slaballoc(&ftable.slab)) == 0)
+    return 0;
+  f->ref = 1;
+  f->text = 0;
+  return f;
 }
 
 // Increment ref count for file f.
@@ -65,13 +66,17 @@ fileclose(struct file *f)
     return;
   }
   ff = *f;
-  f->ref = 0;
-  f->type = FD_NONE;
   release(&ftable.lock);
+  slabfree(&ftable.slab, f);
 
   if(ff.type == FD_PIPE)
     pipeclose(ff.pipe, ff.writable);
   else if(ff.type == FD_INODE){
+    if(ff.text){
+      ilock(ff.ip);
+      ff.ip->ntext--;
+      iunlock(ff.ip);
+    }
     begin_trans();
     iput(ff.ip);
     commit_trans();
@@ -91,6 +96,25 @@ filestat(struct file *f, struct stat *st)
   return -1;
 }
 
+// Read up to n entries, with their metadata, from directory f.
+// Returns the number of entries read.
+int
+filereaddir(struct file *f, struct direntplus *dst, int n)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  if(f->ip->type != T_DIR){
+    iunlock(f->ip);
+    return -1;
+  }
+  r = readdiri(f->ip, dst, &f->off, n);
+  iunlock(f->ip);
+  return r;
+}
+
 // Read from file f.
 int
 fileread(struct file *f, char *addr, int n)
@@ -114,45 +138,310 @@ fileread(struct file *f, char *addr, int n)
   panic("fileread");
 }
 
+// Read from file f at offset off, without using or
+// changing the file's offset.
+int
+filepread(struct file *f, char *addr, int n, uint off)
+{
+  int r;
+
+  if(f->readable == 0 || f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  r = readi(f->ip, addr, off, n);
+  iunlock(f->ip);
+  return r;
+}
+
+// Read from file f into the iovcnt buffers of iov.
+// Stops at the first buffer that is not filled completely.
+int
+filereadv(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int i, r, tot;
+
+  if(f->readable == 0)
+    return -1;
+  if(f->type == FD_PIPE)
+    return pipereadv(f->pipe, iov, iovcnt);
+  if(f->type == FD_INODE){
+    tot = 0;
+    ilock(f->ip);
+    for(i = 0; i < iovcnt; i++){
+      if((r = readi(f->ip, iov[i].iov_base, f->off, iov[i].iov_len)) < 0){
+        if(tot == 0)
+          tot = -1;
+        break;
+      }
+      f->off += r;
+      tot += r;
+      if(r < iov[i].iov_len)
+        break;
+    }
+    iunlock(f->ip);
+    return tot;
+  }
+  panic("filereadv");
+}
+
 //PAGEBREAK!
+// Write a few blocks at a time to avoid exceeding
+// the maximum log transaction size, including
+// i-node, indirect block, allocation blocks,
+// and 2 blocks of slop for non-aligned writes.
+// this really belongs lower down, since writei()
+// might be writing a device like the console.
+#define MAXWRITE (((LOGSIZE-1-1-2) / 2) * 512)
+
+// Write n bytes to inode file f at offset *poff,
+// advancing *poff as the data is written.
+static int
+filewritei(struct file *f, char *addr, int n, uint *poff)
+{
+  int r;
+
+  int i = 0;
+  while(i < n){
+    int n1 = n - i;
+    if(n1 > MAXWRITE)
+      n1 = MAXWRITE;
+
+    begin_trans();
+    ilock(f->ip);
+    if ((r = writei(f->ip, addr + i, *poff, n1)) > 0)
+      *poff += r;
+    iunlock(f->ip);
+    commit_trans();
+
+    if(r < 0)
+      break;
+    if(r != n1)
+      panic("short filewrite");
+    i += r;
+  }
+  return i == n ? n : -1;
+}
+
 // Write to file f.
 int
 filewrite(struct file *f, char *addr, int n)
 {
-  int r;
-
   if(f->writable == 0)
     return -1;
   if(f->type == FD_PIPE)
     return pipewrite(f->pipe, addr, n);
-  if(f->type == FD_INODE){
-    // write a few blocks at a time to avoid exceeding
-    // the maximum log transaction size, including
-    // i-node, indirect block, allocation blocks,
-    // and 2 blocks of slop for non-aligned writes.
-    // this really belongs lower down, since writei()
-    // might be writing a device like the console.
-    int max = ((LOGSIZE-1-1-2) / 2) * 512;
-    int i = 0;
-    while(i < n){
-      int n1 = n - i;
-      if(n1 > max)
-        n1 = max;
+  if(f->type == FD_INODE)
+    return filewritei(f, addr, n, &f->off);
+  panic("filewrite");
+}
+
+// Write the iovcnt buffers of iov to file f.  For inode
+// files, consecutive buffers share a log transaction, up to
+// MAXWRITE bytes each, instead of one transaction per buffer.
+int
+filewritev(struct file *f, struct iovec *iov, int iovcnt)
+{
+  int i, r, n1, off, left, tot;
 
+  if(f->writable == 0)
+    return -1;
+  if(f->type == FD_PIPE){
+    tot = 0;
+    for(i = 0; i < iovcnt; i++){
+      if(pipewrite(f->pipe, iov[i].iov_base, iov[i].iov_len) < 0)
+        return -1;
+      tot += iov[i].iov_len;
+    }
+    return tot;
+  }
+  if(f->type == FD_INODE){
+    tot = 0;
+    i = off = 0;  // next byte to write is at iov[i].iov_base + off
+    while(i < iovcnt){
       begin_trans();
       ilock(f->ip);
-      if ((r = writei(f->ip, addr + i, f->off, n1)) > 0)
+      for(left = MAXWRITE; i < iovcnt && left > 0; left -= n1){
+        n1 = iov[i].iov_len - off;
+        if(n1 > left)
+          n1 = left;
+        if((r = writei(f->ip, (char*)iov[i].iov_base + off, f->off, n1)) < 0){
+          iunlock(f->ip);
+          commit_trans();
+          return -1;
+        }
+        if(r != n1)
+          panic("short filewritev");
         f->off += r;
+        tot += r;
+        off += r;
+        if(off == iov[i].iov_len){
+          i++;
+          off = 0;
+        }
+      }
       iunlock(f->ip);
       commit_trans();
+    }
+    return tot;
+  }
+  panic("filewritev");
+}
+
+// Write to file f at offset off, without using or
+// changing the file's offset.
+int
+filepwrite(struct file *f, char *addr, int n, uint off)
+{
+  if(f->writable == 0 || f->type != FD_INODE)
+    return -1;
+  return filewritei(f, addr, n, &off);
+}
 
+// Move up to n bytes from file in to file out, one of which
+// must be a pipe and the other an inode file.  The data goes
+// between the pipe and the buffer cache without passing through
+// a user buffer.  Like read(), waits until some data can be
+// moved and then moves what it can; returns 0 only at end of
+// file (or end of the pipe's input), or if n is 0.
+int
+filesplice(struct file *in, struct file *out, int n)
+{
+  int r, n1, tot;
+
+  if(in->readable == 0 || out->writable == 0)
+    return -1;
+  if(in->type == FD_INODE && out->type == FD_PIPE){
+    // Another writer may fill the pipe between the wait and
+    // the copy; then nothing moves, and we wait again.
+    for(;;){
+      if(pipewaitwrite(out->pipe) < 0)
+        return -1;
+      ilock(in->ip);
+      if(n == 0 || in->off >= in->ip->size){
+        iunlock(in->ip);
+        return 0;
+      }
+      if((r = readipipe(in->ip, out->pipe, in->off, n)) > 0)
+        in->off += r;
+      iunlock(in->ip);
+      if(r != 0)
+        return r;
+    }
+  }
+  if(in->type == FD_PIPE && out->type == FD_INODE){
+    // Likewise another reader may empty the pipe first.
+    for(;;){
+      if((r = pipewaitread(in->pipe)) <= 0)
+        return r;
+      for(tot = 0; tot < n; tot += r){
+        n1 = n - tot;
+        if(n1 > MAXWRITE)
+          n1 = MAXWRITE;
+        begin_trans();
+        ilock(out->ip);
+        if((r = writeipipe(out->ip, in->pipe, out->off, n1)) > 0)
+          out->off += r;
+        iunlock(out->ip);
+        commit_trans();
+        if(r < 0)
+          return tot > 0 ? tot : -1;
+        if(r < n1){
+          tot += r;
+          break;
+        }
+      }
+      if(tot > 0 || n == 0)
+        return tot;
+    }
+  }
+  return -1;
+}
+
+// A copy writes as much per transaction as the log holds: the
+// data blocks plus the inode, two bitmap blocks, and the single,
+// double and second-level indirect blocks that map them.  The
+// log header takes one more sector.
+#define MAXCOPY ((LOGSIZE-1-1-2-3) * BSIZE)
+
+// Copy up to n bytes from inode file in to inode file out,
+// starting at and advancing each file's offset, without
+// passing the data through user space.  Data is staged a page
+// at a time, and each transaction writes pages until it holds
+// MAXCOPY bytes' worth of blocks.  Returns the number of bytes
+// copied, which is short at the end of in or if a write fails;
+// in's offset moves past only the bytes that were written.
+int
+filecopy(struct file *in, struct file *out, int n)
+{
+  int r, n1, left, tot;
+  char *mem;
+
+  if(in->readable == 0 || out->writable == 0)
+    return -1;
+  if(in->type != FD_INODE || out->type != FD_INODE)
+    return -1;
+  if((mem = kalloc()) == 0)
+    return -1;
+  r = tot = 0;
+  while(tot < n){
+    begin_trans();
+    for(left = MAXCOPY - out->off % BSIZE; left > 0 && tot < n; left -= r){
+      n1 = n - tot;
+      if(n1 > PGSIZE)
+        n1 = PGSIZE;
+      if(n1 > left)
+        n1 = left;
+      ilock(in->ip);
+      r = readi(in->ip, mem, in->off, n1);
+      iunlock(in->ip);
+      if(r <= 0)
+        break;
+      ilock(out->ip);
+      if(writei(out->ip, mem, out->off, r) == r)
+        out->off += r;
+      else
+        r = -1;
+      iunlock(out->ip);
       if(r < 0)
         break;
-      if(r != n1)
-        panic("short filewrite");
-      i += r;
+      in->off += r;
+      tot += r;
     }
-    return i == n ? n : -1;
+    commit_trans();
+    if(r <= 0)
+      break;
   }
-  panic("filewrite");
+  kfree(mem);
+  if(r < 0 && tot == 0)
+    return -1;
+  return tot;
+}
+
+// Set the offset of file f, relative to the start (SEEK_SET),
+// the current offset (SEEK_CUR) or the end (SEEK_END) of the
+// file.  The new offset may not pass the end of the file,
+// since writei() cannot leave holes.  Returns the new offset.
+int
+fileseek(struct file *f, int off, int whence)
+{
+  int base;
+
+  if(f->type != FD_INODE)
+    return -1;
+  ilock(f->ip);
+  if(whence == SEEK_SET)
+    base = 0;
+  else if(whence == SEEK_CUR)
+    base = f->off;
+  else if(whence == SEEK_END)
+    base = f->ip->size;
+  else
+    base = -1;
+  if(base < 0 || base + off < 0 || base + off > f->ip->size){
+    iunlock(f->ip);
+    return -1;
+  }
+  f->off = base + off;
+  iunlock(f->ip);
+  return f->off;
 }
@@ -4,6 +4,7 @@ struct file {
   int ref; // reference count
   char readable;
   char writable;
+  char text;     // maps a program for exec()
   struct pipe *pipe;
   struct inode *ip;
   uint off;
@@ -16,6 +17,9 @@ struct inode {
   uint inum;          // Inode number
   int ref;            // Reference count
   int flags;          // I_BUSY, I_VALID, I_SYMLNK
+  int ntext;          // files mapping it for exec(); no writes while > 0
+  struct inode *prev; // icache list
+  struct inode *next;
 
   short type;         // copy of disk inode
   short major;
@@ -75,11 +75,102 @@ int qualifies(int fd,struct stat st, char *name) {
     return 1;
 }
 
+/* symlinks are not followed: test them as empty files of no type */
+int linkqualifies(char *name) {
+    if ((fname[0] != 0) && (strcmp(fname, name) != 0))
+        return 0;
+    if (size != -1) {
+        switch(size_modifier) {
+        case 0: if (0 != size) return 0;
+            break;
+        case '+' :  if (0 <= size) return 0;
+            break;
+        case '-' :  if (0 > size) return 0;
+            break;
+        default: break;
+        }
+    }
+    switch (type) {
+    case 'd': return 0;
+    case 'f': return 0;
+    default : break;
+    }
+    return 1;
+}
+
+int find(char* path, char *name);
+
+/* Walk the entries of the directory open on fd, whose path is in buf.
+   Subdirectories are opened relative to fd, so each entry costs one
+   lookup no matter how deep it is; buf is only kept for printing. */
+void walk(int fd, char *buf, int bufsize) {
+    char *p;
+    char sympath[512];
+    int i, n, cfd;
+    struct direntplus de[8];
+
+    if(strlen(buf) + 1 + DIRSIZ + 1 > bufsize){
+        printf(1, "find: path too long\n");
+        return;
+    }
+    p = buf+strlen(buf);
+    *p++ = '/';
+
+    while((n = readdirplus(fd, de, sizeof(de)/sizeof(de[0]))) > 0){
+        for(i = 0; i < n; i++){
+            memmove(p, de[i].name, DIRSIZ);
+            p[DIRSIZ] = 0;
+
+            if (de[i].name[0] == '.') /* don't loop yourself to death
+                                         with '.' and '..' */
+                continue;
+
+            if (de[i].st.symlink) {
+                if (!follow) {
+                    if (linkqualifies(p))
+                        printf(1, "%s\n", buf);
+                } else if (readlink(buf, sympath, 50) != -1) {
+                    DEBUG_PRINT(8, "it's a link according to readlink", 999);
+                    find(sympath, namefmt(sympath));
+                } else {
+                    find(buf, p);
+                }
+                continue;
+            }
+
+            if (de[i].st.type == T_DIR) {
+                if ((cfd = openat(fd, p, 0)) < 0) {
+                    printf(2, "find: cannot open %s\n", buf);
+                    continue;
+                }
+                if (qualifies(cfd, de[i].st, namefmt(buf)))
+                    printf(1, "%s\n", buf);
+                walk(cfd, buf, bufsize);
+                close(cfd);
+                continue;
+            }
+
+            /* plain files are decided from the inline stat;
+               only -tag needs an fd. */
+            if (de[i].st.type != T_FILE)
+                continue;
+            cfd = -1;
+            if (key[0] != 0 && (cfd = openat(fd, p, 0)) < 0) {
+                printf(2, "find: cannot open %s\n", buf);
+                continue;
+            }
+            if (qualifies(cfd, de[i].st, p))
+                printf(1, "%s\n", buf);
+            if (cfd >= 0)
+                close(cfd);
+        }
+    }
+}
+
 int find(char* path, char *name) {
-    char buf[512], *p;
+    char buf[512];
     char sympath[512];
     int fd;
-    struct dirent de;
     struct stat st;
 
     DEBUG_PRINT(7, "path = %s, follow = %d", path, follow);
@@ -88,26 +179,8 @@ int find(char* path, char *name) {
         /* "manually perform 'qualifies' for the file" */
         DEBUG_PRINT(7, "local 'qualifies': readlink result = %d",
                     readlink(path, sympath, (uint)50));
-        if ((fname[0] != 0) && (strcmp(fname, name) != 0))
-            return 0;
-        if (size != -1) {
-            switch(size_modifier) {
-            case 0: if (0 != size) return 0;
-                break;
-            case '+' :  if (0 <= size) return 0;
-                break;
-            case '-' :  if (0 > size) return 0;
-                break;
-            default: break;
-            }
-        }
-        switch (type) {
-        case 'd': return 0;
-        case 'f': return 0;
-        default : break;
-        }
-
-        printf(1, "%s\n", path);
+        if (linkqualifies(name))
+            printf(1, "%s\n", path);
         return 0;
     }
 
@@ -152,27 +225,7 @@ int find(char* path, char *name) {
             DEBUG_PRINT(5, "DIR qualifies, path = %s", path);
             printf(1, "%s\n", buf);
         }
-        p = buf+strlen(buf);
-        *p++ = '/';
-
-        while(read(fd, &de, sizeof(de)) == sizeof(de)){
-            if(de.inum == 0)
-                continue;
-            memmove(p, de.name, DIRSIZ);
-            p[DIRSIZ] = 0;
-
-            if (de.name[0] == '.') /* don't loop yourself to death
-                                      with '.' and '..' */
-                continue;
-            if (follow && readlink(buf, sympath, 50) != -1) {/* it is a symlink */
-                DEBUG_PRINT(8, "it's a link according to readlink", 999);
-                find(sympath, namefmt(sympath));
-            } else {
-                DEBUG_PRINT(8, "NOT a link according to readlink. buf = %s",
-                            buf);
-                find(buf, de.name);
-            }
-        }
+        walk(fd, buf, sizeof buf);
         break;
     }
     close(fd);
@@ -19,6 +19,7 @@
 #include "buf.h"
 #include "fs.h"
 #include "file.h"
+#include "slab.h"
 
 #define min(a, b) ((a) < (b) ? (a) : (b))
 static void itrunc(struct inode*);
@@ -119,12 +120,13 @@ bfree(int dev, uint b)
 //   is non-zero. ialloc() allocates, iput() frees if
 //   the link count has fallen to zero.
 //
-// * Referencing in cache: an entry in the inode cache
-//   is free if ip->ref is zero. Otherwise ip->ref tracks
-//   the number of in-memory pointers to the entry (open
-//   files and current directories). iget() to find or
-//   create a cache entry and increment its ref, iput()
-//   to decrement ref.
+// * Referencing in cache: ip->ref tracks the number of
+//   in-memory pointers to a cache entry (open files and
+//   current directories). iget() to find or create a cache
+//   entry and increment its ref, iput() to decrement ref.
+//   Entries are allocated from a slab cache, so the number
+//   of active inodes is limited only by memory; iput()
+//   frees an entry when its ref falls to zero.
 //
 // * Valid: the information (type, size, &c) in an inode
 //   cache entry is only correct when the I_VALID bit
@@ -158,13 +160,15 @@ bfree(int dev, uint b)
 
 struct {
   struct spinlock lock;
-  struct inode inode[NINODE];
+  struct slabcache slab;
+  struct inode *list;   // in-use inodes, through prev/next
 } icache;
 
 void
 iinit(void)
 {
   initlock(&icache.lock, "icache");
+  slabinit(&icache.slab, "inode", sizeof(struct inode));
 }
 
 static struct inode* iget(uint dev, uint inum);
@@ -226,31 +230,31 @@ iupdate(struct inode *ip)
 static struct inode*
 iget(uint dev, uint inum)
 {
-  struct inode *ip, *empty;
+  struct inode *ip;
 
   acquire(&icache.lock);
 
   // Is the inode already cached?
-  empty = 0;
-  for(ip = &icache.inode[0]; ip < &icache.inode[NINODE]; ip++){
-    if(ip->ref > 0 && ip->dev == dev && ip->inum == inum){
+  for(ip = icache.list; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum){
       ip->ref++;
       release(&icache.lock);
       return ip;
     }
-    if(empty == 0 && ip->ref == 0)    // Remember empty slot.
-      empty = ip;
   }
 
-  // Recycle an inode cache entry.
-  if(empty == 0)
+  // Allocate a new inode cache entry.
+  if((ip = slaballoc(&icache.slab)) == 0)
     panic("iget: no inodes");
-
-  ip = empty;
+  ip->next = icache.list;
+  if(icache.list)
+    icache.list->prev = ip;
+  icache.list = ip;
   ip->dev = dev;
   ip->inum = inum;
   ip->ref = 1;
   ip->flags = 0;
+  ip->ntext = 0;
   release(&icache.lock);
 
   return ip;
@@ -317,8 +321,8 @@ iunlock(struct inode *ip)
 }
 
 // Drop a reference to an in-memory inode.
-// If that was the last reference, the inode cache entry can
-// be recycled.
+// If that was the last reference, the inode cache entry is
+// freed.
 // If that was the last reference and the inode has no links
 // to it, free the inode (and its content) on disk.
 void
@@ -338,7 +342,15 @@ iput(struct inode *ip)
     ip->flags = 0;
     wakeup(ip);
   }
-  ip->ref--;
+  if(--ip->ref == 0){
+    if(ip->prev)
+      ip->prev->next = ip->next;
+    else
+      icache.list = ip->next;
+    if(ip->next)
+      ip->next->prev = ip->prev;
+    slabfree(&icache.slab, ip);
+  }
   release(&icache.lock);
 }
 
@@ -429,6 +441,8 @@ itrunc(struct inode *ip)
   struct buf *bp, *bp2;
   uint *a, *a2;
 
+  pcacheinval(ip->dev, ip->inum);
+
   //A&T checks is symlink , delete the path stored in ip->addrs
   if(ip->flags & I_SYMLNK) {
       memset(ip->addrs,0,sizeof(ip->addrs));
@@ -497,6 +511,39 @@ stati(struct inode *ip, struct stat *st)
   st->symlink = (ip->flags & I_SYMLNK);
 }
 
+// Copy stat information for inode inum on dev without
+// locking it or taking a reference.  Uses the in-core copy
+// if one is cached and valid, otherwise reads the on-disk
+// inode.  The result is a snapshot and may be stale by the
+// time the caller looks at it.
+static void
+statinum(uint dev, uint inum, struct stat *st)
+{
+  struct inode *ip;
+  struct buf *bp;
+  struct dinode *dip;
+
+  acquire(&icache.lock);
+  for(ip = icache.list; ip; ip = ip->next){
+    if(ip->dev == dev && ip->inum == inum && (ip->flags & I_VALID)){
+      stati(ip, st);
+      release(&icache.lock);
+      return;
+    }
+  }
+  release(&icache.lock);
+
+  bp = bread(dev, IBLOCK(inum));
+  dip = (struct dinode*)bp->data + inum%IPB;
+  st->dev = dev;
+  st->ino = inum;
+  st->type = dip->type;
+  st->nlink = dip->nlink;
+  st->size = dip->size;
+  st->symlink = 0;
+  brelse(bp);
+}
+
 //PAGEBREAK!
 // Read data from inode.
 int
@@ -539,6 +586,10 @@ writei(struct inode *ip, char *src, uint off, uint n)
     return devsw[ip->major].write(ip, src, n);
   }
 
+  // A running program's pages are read from its file as
+  // they are used, so the file must not change under it.
+  if(ip->ntext > 0)
+    return -1;
   if(off > ip->size || off + n < off)
     return -1;
   if(off + n > MAXFILE*BSIZE)
@@ -556,9 +607,90 @@ writei(struct inode *ip, char *src, uint off, uint n)
     ip->size = off;
     iupdate(ip);
   }
+  // Cached pages of the file are stale now.
+  if(n > 0)
+    pcachewrite(ip, off - n, n);
   return n;
 }
 
+// Move up to n bytes of ip, starting at off, from the buffer
+// cache into pipe p without sleeping on the pipe.  Stops early
+// when the pipe fills.  Returns the number of bytes moved.
+int
+readipipe(struct inode *ip, struct pipe *p, uint off, uint n)
+{
+  uint tot, m;
+  int r;
+  struct buf *bp;
+
+  if(ip->type == T_DEV || off > ip->size || off + n < off)
+    return -1;
+  if(off + n > ip->size)
+    n = ip->size - off;
+
+  for(tot=0; tot<n; tot+=r, off+=r){
+    bp = bread(ip->dev, bmap(ip, off/BSIZE));
+    m = min(n - tot, BSIZE - off%BSIZE);
+    r = pipeput(p, (char*)bp->data + off%BSIZE, m);
+    brelse(bp);
+    if(r < 0)
+      return tot > 0 ? tot : -1;
+    if(r < m){
+      tot += r;
+      break;
+    }
+  }
+  return tot;
+}
+
+// Move up to n bytes from pipe p into ip at off, straight into
+// the buffer cache, without sleeping on the pipe.  Stops early
+// when the pipe empties.  Returns the number of bytes moved.
+// A block past the end of the file is allocated only once
+// there is data for it, so it goes through a bounce buffer.
+int
+writeipipe(struct inode *ip, struct pipe *p, uint off, uint n)
+{
+  uint tot, m, r;
+  struct buf *bp;
+  char bounce[BSIZE];
+
+  if(ip->type != T_FILE || ip->ntext > 0 || off > ip->size || off + n < off)
+    return -1;
+  if(off + n > MAXFILE*BSIZE)
+    return -1;
+
+  for(tot=0; tot<n; tot+=r, off+=r){
+    m = min(n - tot, BSIZE - off%BSIZE);
+    if(off%BSIZE == 0 && off >= ip->size){
+      // The block is not allocated yet.
+      if((r = pipeget(p, bounce, m)) == 0)
+        break;
+      bp = bread(ip->dev, bmap(ip, off/BSIZE));
+      memmove(bp->data, bounce, r);
+    } else {
+      bp = bread(ip->dev, bmap(ip, off/BSIZE));
+      r = pipeget(p, (char*)bp->data + off%BSIZE, m);
+    }
+    if(r > 0)
+      log_write(bp);
+    brelse(bp);
+    if(r < m){
+      tot += r;
+      off += r;
+      break;
+    }
+  }
+
+  if(tot > 0 && off > ip->size){
+    ip->size = off;
+    iupdate(ip);
+  }
+  if(tot > 0)
+    pcachewrite(ip, off - tot, tot);
+  return tot;
+}
+
 //PAGEBREAK!
 // Directories
 
@@ -596,6 +728,36 @@ dirlookup(struct inode *dp, char *name, uint *poff)
   return 0;
 }
 
+// Read up to n in-use entries of directory dp, starting at
+// byte offset *poff, into dst together with the stat of each
+// entry's inode.  Advances *poff past the entries consumed and
+// returns the number of entries filled.  Caller must hold dp
+// locked; the entries' inodes are not locked (see statinum).
+int
+readdiri(struct inode *dp, struct direntplus *dst, uint *poff, int n)
+{
+  int i;
+  uint off;
+  struct dirent de;
+
+  if(dp->type != T_DIR)
+    panic("readdiri not DIR");
+
+  i = 0;
+  for(off = *poff; i < n && off + sizeof(de) <= dp->size; off += sizeof(de)){
+    if(readi(dp, (char*)&de, off, sizeof(de)) != sizeof(de))
+      panic("readdiri read");
+    if(de.inum == 0)
+      continue;
+    dst[i].inum = de.inum;
+    memmove(dst[i].name, de.name, DIRSIZ);
+    statinum(dp->dev, de.inum, &dst[i].st);
+    i++;
+  }
+  *poff = off;
+  return i;
+}
+
 // Write a new directory entry (name, inum) into the directory dp.
 int
 dirlink(struct inode *dp, char *name, uint inum)
@@ -667,15 +829,19 @@ skipelem(char *path, char *name)
 }
 
 // Look up and return the inode for a path name.
+// A relative path starts at dp, or at the current
+// directory if dp is 0.
 // If parent != 0, return the inode for the parent and copy the final
 // path element into name, which must have room for DIRSIZ bytes.
 static struct inode*
-namex(char *path, int nameiparent, char *name)
+namex(struct inode *dp, char *path, int nameiparent, char *name)
 {
   struct inode *ip, *next;
 
   if(*path == '/')
     ip = iget(ROOTDEV, ROOTINO);
+  else if(dp)
+    ip = idup(dp);
   else
     ip = idup(proc->cwd);
 
@@ -708,13 +874,28 @@ struct inode*
 namei(char *path)
 {
   char name[DIRSIZ];
-  return namex(path, 0, name);
+  return namex(0, path, 0, name);
 }
 
 struct inode*
 nameiparent(char *path, char *name)
 {
-  return namex(path, 1, name);
+  return namex(0, path, 1, name);
+}
+
+// Like namei and nameiparent, but a relative path starts
+// at directory dp rather than the current directory.
+struct inode*
+nameiat(struct inode *dp, char *path)
+{
+  char name[DIRSIZ];
+  return namex(dp, path, 0, name);
+}
+
+struct inode*
+nameiparentat(struct inode *dp, char *path, char *name)
+{
+  return namex(dp, path, 1, name);
 }
 
 /* A&T tag support - create tag (allocate a block if necessary). */
@@ -58,3 +58,11 @@ struct dirent {
   ushort inum;
   char name[DIRSIZ];
 };
+
+// A directory entry together with the metadata of the inode
+// it names, as returned by readdirplus().
+struct direntplus {
+  ushort inum;
+  char name[DIRSIZ];
+  struct stat st;
+};
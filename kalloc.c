@@ -1,14 +1,31 @@
 // Physical memory allocator, intended to allocate
 // memory for user processes, kernel stacks, page table pages,
 // and pipe buffers. Allocates 4096-byte pages.
+//
+// Each CPU keeps a small cache of free pages in front of the
+// global free list, so most kalloc() and kfree() calls only
+// take that CPU's own lock.  Pages move between a cache and
+// the global list KBATCH at a time.
+//
+// Idle CPUs zero free pages ahead of time into a pool of up to
+// NZERO pages, which kalloc_zeroed() hands out without having
+// to clear them.  kalloc() only dips into the pool when every
+// other free page is gone.  Freed pages are not cleared; a
+// kernel built with KDEBUG fills them with junk instead, to
+// catch dangling references.
 
 #include "types.h"
 #include "defs.h"
 #include "param.h"
 #include "memlayout.h"
 #include "mmu.h"
+#include "x86.h"
+#include "proc.h"
 #include "spinlock.h"
 
+#define KBATCH 16   // a CPU caches at most 2*KBATCH pages
+#define NZERO  64   // pre-zeroed pages kept for kalloc_zeroed()
+
 void freerange(void *vstart, void *vend);
 extern char end[]; // first address after kernel loaded from ELF file
 
@@ -16,10 +33,20 @@ struct run {
   struct run *next;
 };
 
+struct kcache {
+  struct spinlock lock;
+  struct run *freelist;
+  int n;                       // pages on freelist
+};
+
 struct {
   struct spinlock lock;
   int use_lock;
   struct run *freelist;
+  struct kcache cpu[NCPU];     // per-CPU caches, indexed like cpus[]
+  struct run *zero;            // pre-zeroed pages, apart from next
+  int nzero;
+  int ref[PHYSTOP/PGSIZE];     // mappings of each page, for copy-on-write
 } kmem;
 
 // Initialization happens in two phases.
@@ -30,7 +57,11 @@ struct {
 void
 kinit1(void *vstart, void *vend)
 {
+  int i;
+
   initlock(&kmem.lock, "kmem");
+  for(i = 0; i < NCPU; i++)
+    initlock(&kmem.cpu[i].lock, "kcache");
   kmem.use_lock = 0;
   freerange(vstart, vend);
 }
@@ -47,33 +78,141 @@ freerange(void *vstart, void *vend)
 {
   char *p;
   p = (char*)PGROUNDUP((uint)vstart);
-  for(; p + PGSIZE <= (char*)vend; p += PGSIZE)
+  for(; p + PGSIZE <= (char*)vend; p += PGSIZE){
+    kmem.ref[v2p(p) / PGSIZE] = 1;
     kfree(p);
+  }
+}
+
+// Detach up to n pages from the front of *list.
+// Returns the first, sets *tail to the last and *np
+// to how many there are.
+static struct run*
+ktake(struct run **list, int n, struct run **tail, int *np)
+{
+  struct run *head, *r;
+  int i;
+
+  head = *list;
+  r = 0;
+  for(i = 0; i < n && *list; i++){
+    r = *list;
+    *list = r->next;
+  }
+  if(r)
+    r->next = 0;
+  *tail = r;
+  *np = i;
+  return i > 0 ? head : 0;
 }
 
 //PAGEBREAK: 21
-// Free the page of physical memory pointed at by v,
-// which normally should have been returned by a
+// Drop a reference to the page of physical memory pointed
+// at by v, which normally should have been returned by a
 // call to kalloc().  (The exception is when
 // initializing the allocator; see kinit above.)
+// The page is freed when its last reference goes.
 void
 kfree(char *v)
 {
-  struct run *r;
+  struct run *r, *batch, *tail;
+  struct kcache *c;
+  int n, old;
 
   if((uint)v % PGSIZE || v < end || v2p(v) >= PHYSTOP)
     panic("kfree");
 
+  old = fetchadd(&kmem.ref[v2p(v) / PGSIZE], -1);
+  if(old <= 0)
+    panic("kfree: not allocated");
+  if(old > 1)
+    return;
+
+#ifdef KDEBUG
   // Fill with junk to catch dangling refs.
   memset(v, 1, PGSIZE);
+#endif
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
   r = (struct run*)v;
-  r->next = kmem.freelist;
-  kmem.freelist = r;
-  if(kmem.use_lock)
+  if(!kmem.use_lock){
+    r->next = kmem.freelist;
+    kmem.freelist = r;
+    return;
+  }
+
+  pushcli();
+  c = &kmem.cpu[cpu - cpus];
+  acquire(&c->lock);
+  r->next = c->freelist;
+  c->freelist = r;
+  c->n++;
+  batch = 0;
+  if(c->n > 2*KBATCH){
+    batch = ktake(&c->freelist, KBATCH, &tail, &n);
+    c->n -= n;
+  }
+  release(&c->lock);
+  if(batch){
+    acquire(&kmem.lock);
+    tail->next = kmem.freelist;
+    kmem.freelist = batch;
     release(&kmem.lock);
+  }
+  popcli();
+}
+
+// Refill cache c, which is empty, with a batch from the
+// global list or, if that is empty too, with half of
+// another CPU's cache.  Returns one of the pages, or 0.
+static struct run*
+krefill(struct kcache *c)
+{
+  struct run *batch, *tail;
+  struct kcache *o;
+  int n;
+
+  acquire(&kmem.lock);
+  batch = ktake(&kmem.freelist, KBATCH, &tail, &n);
+  release(&kmem.lock);
+
+  for(o = kmem.cpu; n == 0 && o < &kmem.cpu[NCPU]; o++){
+    if(o == c)
+      continue;
+    acquire(&o->lock);
+    batch = ktake(&o->freelist, (o->n + 1) / 2, &tail, &n);
+    o->n -= n;
+    release(&o->lock);
+  }
+  if(n == 0)
+    return 0;
+
+  if(n > 1){
+    acquire(&c->lock);
+    tail->next = c->freelist;
+    c->freelist = batch->next;
+    c->n += n - 1;
+    release(&c->lock);
+  }
+  return batch;
+}
+
+// Take a page from the pre-zeroed pool, clearing the one
+// word of it that the pool used.  Returns 0 if it is empty.
+static struct run*
+kzerotake(void)
+{
+  struct run *r;
+
+  acquire(&kmem.lock);
+  r = kmem.zero;
+  if(r){
+    kmem.zero = r->next;
+    kmem.nzero--;
+  }
+  release(&kmem.lock);
+  if(r)
+    r->next = 0;
+  return r;
 }
 
 // Allocate one 4096-byte page of physical memory.
@@ -83,14 +222,85 @@ char*
 kalloc(void)
 {
   struct run *r;
+  struct kcache *c;
 
-  if(kmem.use_lock)
-    acquire(&kmem.lock);
-  r = kmem.freelist;
+  if(!kmem.use_lock){
+    r = kmem.freelist;
+    if(r)
+      kmem.freelist = r->next;
+  } else {
+    pushcli();
+    c = &kmem.cpu[cpu - cpus];
+    acquire(&c->lock);
+    r = c->freelist;
+    if(r){
+      c->freelist = r->next;
+      c->n--;
+    }
+    release(&c->lock);
+    if(r == 0)
+      r = krefill(c);
+    if(r == 0)
+      r = kzerotake();
+    popcli();
+  }
   if(r)
-    kmem.freelist = r->next;
-  if(kmem.use_lock)
-    release(&kmem.lock);
+    kmem.ref[v2p(r) / PGSIZE] = 1;
   return (char*)r;
 }
 
+// Allocate one page of physical memory, filled with zeros.
+// Returns 0 if the memory cannot be allocated.
+char*
+kalloc_zeroed(void)
+{
+  struct run *r;
+  char *v;
+
+  if(kmem.use_lock && (r = kzerotake()) != 0){
+    kmem.ref[v2p(r) / PGSIZE] = 1;
+    return (char*)r;
+  }
+  if((v = kalloc()) != 0)
+    memset(v, 0, PGSIZE);
+  return v;
+}
+
+// Called by scheduler() when it has nothing to run:
+// zero one free page and add it to the pool.
+// Returns 0 if the pool is full or no page is free.
+int
+kzero(void)
+{
+  struct run *r;
+
+  if(kmem.nzero >= NZERO)
+    return 0;
+  if((r = (struct run*)kalloc()) == 0)
+    return 0;
+  memset(r, 0, PGSIZE);
+  kmem.ref[v2p(r) / PGSIZE] = 0;
+  acquire(&kmem.lock);
+  r->next = kmem.zero;
+  kmem.zero = r;
+  kmem.nzero++;
+  release(&kmem.lock);
+  return 1;
+}
+
+// Add a reference to page v, which is being mapped
+// a second time by copy-on-write fork.
+void
+kref(char *v)
+{
+  if((uint)v % PGSIZE || v < end || v2p(v) >= PHYSTOP)
+    panic("kref");
+  fetchadd(&kmem.ref[v2p(v) / PGSIZE], 1);
+}
+
+// Return the number of references to page v.
+int
+krefcount(char *v)
+{
+  return kmem.ref[v2p(v) / PGSIZE];
+}
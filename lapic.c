@@ -39,6 +39,8 @@
 #define TCCR    (0x0390/4)   // Timer Current Count
 #define TDCR    (0x03E0/4)   // Timer Divide Configuration
 
+#define TIMERCOUNT 10000000   // bus cycles per timer interrupt
+
 volatile uint *lapic;  // Initialized in mp.c
 
 static void
@@ -64,7 +66,7 @@ lapicinit(int c)
   // TICR would be calibrated using an external time source.
   lapicw(TDCR, X1);
   lapicw(TIMER, PERIODIC | (T_IRQ0 + IRQ_TIMER));
-  lapicw(TICR, 10000000); 
+  lapicw(TICR, TIMERCOUNT);
 
   // Disable logical interrupt lines.
   lapicw(LINT0, MASKED);
@@ -123,6 +125,28 @@ lapiceoi(void)
     lapicw(EOI, 0);
 }
 
+// Stop (on == 0) or restart this CPU's timer.  An idle CPU
+// needs no timer interrupts to preempt anything.
+void
+lapictimer(int on)
+{
+  if(lapic)
+    lapicw(TICR, on ? TIMERCOUNT : 0);
+}
+
+// Interrupt the CPU with local APIC ID apicid, to wake it
+// from hlt.
+void
+lapicwakeup(uchar apicid)
+{
+  if(!lapic)
+    return;
+  lapicw(ICRHI, apicid<<24);
+  lapicw(ICRLO, FIXED | ASSERT | (T_IRQ0 + IRQ_WAKEUP));
+  while(lapic[ICRLO] & DELIVS)
+    ;
+}
+
 // Spin for a given number of microseconds.
 // On real hardware would want to tune this dynamically.
 void
@@ -0,0 +1,24 @@
+#include "types.h"
+#include "param.h"
+#include "stat.h"
+#include "user.h"
+#include "lockstat.h"
+
+struct lockstat ls[NLOCKSTAT];
+
+// Print the contention counters of the kernel's locks.
+int
+main(int argc, char **argv)
+{
+  int i, n;
+
+  if((n = lockstat(ls, NLOCKSTAT)) < 0){
+    printf(2, "lockstat failed\n");
+    exit();
+  }
+  printf(1, "name acquires contended kcycles\n");
+  for(i = 0; i < n; i++)
+    printf(1, "%s %d %d %d\n", ls[i].name, ls[i].nacquire,
+           ls[i].ncontend, ls[i].kspin);
+  exit();
+}
@@ -0,0 +1,8 @@
+// Contention counters for one kernel spinlock, as returned
+// by the lockstat() system call.
+struct lockstat {
+  char name[16];   // Name given to initlock()
+  uint nacquire;   // Times acquired
+  uint ncontend;   // Times a CPU had to wait for it
+  uint kspin;      // Cycles spent waiting, in units of 1024
+};
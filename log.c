@@ -2,6 +2,7 @@
 #include "defs.h"
 #include "param.h"
 #include "spinlock.h"
+#include "stat.h"
 #include "fs.h"
 #include "buf.h"
 
@@ -26,8 +26,8 @@ void
 ls(char *path)
 {
   char buf[512], *p;
-  int fd;
-  struct dirent de;
+  int fd, i, n;
+  struct direntplus de[BSIZE/sizeof(struct dirent)];
   struct stat st;
 
   if (readlink(path, buf, 512) != -1) {
@@ -60,23 +60,22 @@ ls(char *path)
     strcpy(buf, path);
     p = buf+strlen(buf);
     *p++ = '/';
-    while(read(fd, &de, sizeof(de)) == sizeof(de)){
-      if(de.inum == 0)
-        continue;
-      memmove(p, de.name, DIRSIZ);
-      p[DIRSIZ] = 0;
+    // One readdirplus() per directory block, instead of a
+    // readlink() and stat() per entry.
+    while((n = readdirplus(fd, de, sizeof(de)/sizeof(de[0]))) > 0){
+      for(i = 0; i < n; i++){
+        memmove(p, de[i].name, DIRSIZ);
+        p[DIRSIZ] = 0;
 
-      if (readlink(buf, path, 5) != -1) {
-          /* it's a symlink */
-          printf(1,  "%s %d %d %d\n", fmtname(buf), 2 /* st.type */,
-                 42/* st.ino */, 0/* st.size */);
-          continue;
+        if (de[i].st.symlink) {
+            /* it's a symlink */
+            printf(1,  "%s %d %d %d\n", fmtname(buf), 2 /* st.type */,
+                   42/* st.ino */, 0/* st.size */);
+            continue;
+        }
+        printf(1, "%s %d %d %d\n", fmtname(buf), de[i].st.type,
+               de[i].st.ino, de[i].st.size);
       }
-      if(stat(buf, &st) < 0){
-        printf(1, "ls: cannot stat %s\n", buf);
-        continue;
-      }
-      printf(1, "%s %d %d %d\n", fmtname(buf), st.type, st.ino, st.size);
     }
     break;
   }
@@ -30,6 +30,7 @@ main(void)
   pinit();         // process table
   tvinit();        // trap vectors
   binit();         // buffer cache
+  pcacheinit();    // shared file pages
   fileinit();      // file table
   iinit();         // inode cache
   ideinit();       // disk
@@ -7,11 +7,11 @@
 
 #define stat xv6_stat  // avoid clash with host struct stat
 #include "types.h"
-#include "fs.h"
 #include "stat.h"
+#include "fs.h"
 #include "param.h"
 
-int nblocks = 32696; /* was 985. */
+int nblocks = 32676; /* was 985. */
 
 int nlog = LOGSIZE;
 int ninodes = 200;		/* A&T size: 50 blocks. (was 25,
@@ -0,0 +1,428 @@
+//
+// Memory-mapped files.
+// mmap() only reserves a range of addresses; each page is
+// read from the file by the page-fault handler the first time
+// it is touched.
+//
+// Pages come from a small cache of file pages keyed by inode
+// and offset.  Whole pages of private regions, which include
+// the program segments that exec() maps, are mapped read-only
+// and copy-on-write: every process running the same binary
+// maps the same physical text pages, and an exec() of a program
+// that is already running reads nothing from disk.  Writing or
+// truncating a file drops its private pages from the cache.
+//
+// Shared regions map the cache's shared page for that offset
+// writable, so every process mapping it sees the others'
+// stores at once.  write() copies the new bytes into the
+// shared pages it overlaps rather than dropping them, and a
+// page is written back through the log, whole, when a process
+// that dirtied it unmaps it or exits; until then read() and
+// the buffer cache see the old contents.  A shared page stays
+// cached while any process maps it.  If every entry is in use
+// that way, a new shared page is left uncached and the
+// process that faulted it gets a copy of its own.
+//
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "stat.h"
+#include "memlayout.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "fs.h"
+#include "file.h"
+#include "fcntl.h"
+#include "spinlock.h"
+
+struct {
+  struct spinlock lock;
+  struct {
+    uint dev;
+    uint inum;
+    uint off;
+    int shared;      // page of MAP_SHARED regions
+    char *page;      // 0 if the entry is free
+  } e[NPCACHE];
+  uint hand;         // next entry to reuse when full
+  uint gen;          // bumped whenever a file changes
+} pcache;
+
+void
+pcacheinit(void)
+{
+  initlock(&pcache.lock, "pcache");
+}
+
+// Drop the cached pages of inode dev, inum.
+// Pages already mapped stay in their page tables.
+void
+pcacheinval(uint dev, uint inum)
+{
+  int i;
+
+  acquire(&pcache.lock);
+  pcache.gen++;
+  for(i = 0; i < NPCACHE; i++){
+    if(pcache.e[i].page && pcache.e[i].dev == dev && pcache.e[i].inum == inum){
+      kfree(pcache.e[i].page);
+      pcache.e[i].page = 0;
+    }
+  }
+  release(&pcache.lock);
+}
+
+// Bytes [off, off+n) of ip have just been written.  Drop the
+// private pages of ip and copy the new bytes into its shared
+// pages.  The caller holds ip's lock.
+void
+pcachewrite(struct inode *ip, uint off, uint n)
+{
+  int i;
+  uint a, lo, hi;
+  char *mem;
+
+  acquire(&pcache.lock);
+  pcache.gen++;
+  for(i = 0; i < NPCACHE; i++){
+    if(pcache.e[i].page && !pcache.e[i].shared &&
+       pcache.e[i].dev == ip->dev && pcache.e[i].inum == ip->inum){
+      kfree(pcache.e[i].page);
+      pcache.e[i].page = 0;
+    }
+  }
+  release(&pcache.lock);
+
+  for(a = PGROUNDDOWN(off); a < off + n; a += PGSIZE){
+    acquire(&pcache.lock);
+    mem = 0;
+    for(i = 0; i < NPCACHE; i++){
+      if(pcache.e[i].page && pcache.e[i].shared &&
+         pcache.e[i].dev == ip->dev && pcache.e[i].inum == ip->inum &&
+         pcache.e[i].off == a){
+        mem = pcache.e[i].page;
+        kref(mem);
+        break;
+      }
+    }
+    release(&pcache.lock);
+    if(mem == 0)
+      continue;
+    lo = off > a ? off : a;
+    hi = off + n < a + PGSIZE ? off + n : a + PGSIZE;
+    readi(ip, mem + (lo - a), lo, hi - lo);
+    kfree(mem);
+  }
+}
+
+// Return the entry of the cache for dev, inum, off, or -1.
+// The caller holds pcache.lock.
+static int
+pcachefind(uint dev, uint inum, uint off, int shared)
+{
+  int i;
+
+  for(i = 0; i < NPCACHE; i++)
+    if(pcache.e[i].page && pcache.e[i].dev == dev &&
+       pcache.e[i].inum == inum && pcache.e[i].off == off &&
+       pcache.e[i].shared == shared)
+      return i;
+  return -1;
+}
+
+// Return an entry to reuse, or -1 if every entry holds a
+// shared page that is mapped.  The caller holds pcache.lock.
+static int
+pcachevictim(void)
+{
+  int i, n;
+
+  for(i = 0; i < NPCACHE; i++)
+    if(pcache.e[i].page == 0)
+      return i;
+  for(n = 0; n < NPCACHE; n++){
+    i = pcache.hand;
+    pcache.hand = (pcache.hand + 1) % NPCACHE;
+    if(!pcache.e[i].shared || krefcount(pcache.e[i].page) == 1)
+      return i;
+  }
+  return -1;
+}
+
+// Return the private or shared page of f at offset off, with
+// a reference for the caller, reading it into the cache if it
+// is not there.
+static char*
+pcachepage(struct file *f, uint off, int shared)
+{
+  int i;
+  uint dev, inum, gen;
+  char *mem, *old;
+
+  dev = f->ip->dev;
+  inum = f->ip->inum;
+again:
+  acquire(&pcache.lock);
+  if((i = pcachefind(dev, inum, off, shared)) >= 0){
+    mem = pcache.e[i].page;
+    kref(mem);
+    release(&pcache.lock);
+    return mem;
+  }
+  gen = pcache.gen;
+  release(&pcache.lock);
+
+  if((mem = kalloc_zeroed()) == 0)
+    return 0;
+  filepread(f, mem, PGSIZE, off);
+
+  // Cache the page unless the file was written while it was
+  // being read, or another process cached it first.  A shared
+  // page must not miss such a write, so read it again.
+  acquire(&pcache.lock);
+  if(gen != pcache.gen){
+    release(&pcache.lock);
+    if(shared){
+      kfree(mem);
+      goto again;
+    }
+    return mem;
+  }
+  if((i = pcachefind(dev, inum, off, shared)) >= 0){
+    old = pcache.e[i].page;
+    kref(old);
+    release(&pcache.lock);
+    kfree(mem);
+    return old;
+  }
+  if((i = pcachevictim()) < 0){
+    release(&pcache.lock);
+    return mem;
+  }
+  old = pcache.e[i].page;
+  pcache.e[i].dev = dev;
+  pcache.e[i].inum = inum;
+  pcache.e[i].off = off;
+  pcache.e[i].shared = shared;
+  pcache.e[i].page = mem;
+  kref(mem);
+  release(&pcache.lock);
+  if(old)
+    kfree(old);
+  return mem;
+}
+
+// Return the region of p containing va, or 0.
+struct vma*
+findvma(struct proc *p, uint va)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->f && va >= v->addr && va < v->addr + v->len)
+      return v;
+  return 0;
+}
+
+// Lowest address used by a region above the heap, which is
+// as far as the heap may grow.
+uint
+mmaplimit(struct proc *p)
+{
+  struct vma *v;
+  uint lim;
+
+  lim = KERNBASE;
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->f && v->addr >= p->sz && v->addr < lim)
+      lim = v->addr;
+  return lim;
+}
+
+// Is [va, va+n) inside a single region of p above p->sz?
+int
+mmapvalid(struct proc *p, uint va, uint n)
+{
+  struct vma *v;
+
+  if((v = findvma(p, va)) == 0 || v->addr < p->sz)
+    return 0;
+  return va + n >= va && va + n <= v->addr + v->len;
+}
+
+// Map len bytes of f, starting at offset off, into the
+// current process.  Returns the address chosen, or -1.
+int
+mmap(struct file *f, int off, int len, int prot, int flags)
+{
+  struct vma *v, *fv;
+  struct stat st;
+  uint addr;
+
+  if(off < 0 || off % PGSIZE || len <= 0)
+    return -1;
+  if(flags != MAP_SHARED && flags != MAP_PRIVATE)
+    return -1;
+  if(filestat(f, &st) < 0 || st.type != T_FILE || !f->readable)
+    return -1;
+  if(flags == MAP_SHARED && (prot & PROT_WRITE) &&
+     (!f->writable || f->ip->ntext > 0))
+    return -1;
+
+  fv = 0;
+  for(v = proc->vma; v < &proc->vma[NVMA]; v++)
+    if(v->f == 0){
+      fv = v;
+      break;
+    }
+  if(fv == 0)
+    return -1;
+  addr = mmaplimit(proc) - PGROUNDUP(len);
+  if(PGROUNDUP(len) > mmaplimit(proc) || addr < PGROUNDUP(proc->sz))
+    return -1;
+
+  fv->addr = addr;
+  fv->len = PGROUNDUP(len);
+  fv->off = off;
+  fv->flen = fv->len;
+  fv->prot = prot;
+  fv->flags = flags;
+  fv->f = filedup(f);
+  return addr;
+}
+
+// Write a page of a shared region back to its file if the
+// process has modified it.  Never extends the file.
+static void
+writeback(struct vma *v, uint a, pte_t pte)
+{
+  struct stat st;
+  uint off, n;
+
+  if(v->flags != MAP_SHARED || !(v->prot & PROT_WRITE) || !(pte & PTE_D))
+    return;
+  off = v->off + (a - v->addr);
+  if(filestat(v->f, &st) < 0 || off >= st.size)
+    return;
+  n = st.size - off;
+  if(n > PGSIZE)
+    n = PGSIZE;
+  filepwrite(v->f, p2v(PTE_ADDR(pte)), n, off);
+}
+
+// Unmap region v of p, writing back and freeing its pages.
+static void
+unmapvma(struct proc *p, struct vma *v)
+{
+  uint a;
+  pte_t *pte;
+
+  for(a = v->addr; a < v->addr + v->len; a += PGSIZE){
+    if((pte = walkpgdir(p->pgdir, (char*)a, 0)) == 0 || !(*pte & PTE_P))
+      continue;
+    writeback(v, a, *pte);
+    kfree(p2v(PTE_ADDR(*pte)));
+    *pte = 0;
+  }
+  fileclose(v->f);
+  v->f = 0;
+  if(p == proc)
+    lcr3(v2p(p->pgdir));
+}
+
+// Remove the region that starts at addr and is len bytes long.
+int
+munmap(uint addr, int len)
+{
+  struct vma *v;
+
+  if((v = findvma(proc, addr)) == 0 || v->addr != addr ||
+     v->len != PGROUNDUP(len))
+    return -1;
+  unmapvma(proc, v);
+  return 0;
+}
+
+// Remove every region of p, as exit() and exec() must.
+void
+mmapclear(struct proc *p)
+{
+  struct vma *v;
+
+  for(v = p->vma; v < &p->vma[NVMA]; v++)
+    if(v->f)
+      unmapvma(p, v);
+}
+
+// Give child np the same regions as p.  The pages
+// themselves are shared by copyuvm().
+void
+mmapfork(struct proc *np, struct proc *p)
+{
+  int i;
+
+  for(i = 0; i < NVMA; i++){
+    np->vma[i] = p->vma[i];
+    if(p->vma[i].f)
+      np->vma[i].f = filedup(p->vma[i].f);
+  }
+}
+
+// Handle a page fault at va in region v of p by reading the
+// page from the file.  Returns -1 if the access is not allowed.
+int
+mmapfault(struct proc *p, struct vma *v, uint va, uint err)
+{
+  char *mem, *cmem;
+  uint a, n;
+  int perm;
+
+  if(err & FEC_PR)
+    return -1;
+  if((err & FEC_WR) && !(v->prot & PROT_WRITE))
+    return -1;
+
+  a = PGROUNDDOWN(va);
+  perm = PTE_U;
+  if(v->prot & PROT_WRITE)
+    perm |= PTE_W;
+  if(v->flags == MAP_SHARED)
+    perm |= PTE_SHARED;
+
+  if(v->flags == MAP_SHARED){
+    if((mem = pcachepage(v->f, v->off + (a - v->addr), 1)) == 0)
+      return -1;
+  } else if(a - v->addr + PGSIZE <= v->flen){
+    // A whole page of the file: share the cached copy,
+    // unless the process is about to write it anyway.
+    if((mem = pcachepage(v->f, v->off + (a - v->addr), 0)) == 0)
+      return -1;
+    if(err & FEC_WR){
+      if((cmem = kalloc()) == 0){
+        kfree(mem);
+        return -1;
+      }
+      memmove(cmem, mem, PGSIZE);
+      kfree(mem);
+      mem = cmem;
+    } else if(perm & PTE_W)
+      perm = (perm & ~PTE_W) | PTE_COW;
+  } else {
+    if((mem = kalloc_zeroed()) == 0)
+      return -1;
+    // Past flen or the end of the file the page stays zero.
+    if(a - v->addr < v->flen){
+      n = v->flen - (a - v->addr);
+      if(n > PGSIZE)
+        n = PGSIZE;
+      filepread(v->f, mem, n, v->off + (a - v->addr));
+    }
+  }
+  if(mappages(p->pgdir, (char*)a, PGSIZE, v2p(mem), perm) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
@@ -139,13 +139,19 @@ struct segdesc {
 #define PTE_D           0x040   // Dirty
 #define PTE_PS          0x080   // Page Size
 #define PTE_MBZ         0x180   // Bits must be zero
+#define PTE_COW         0x200   // Copy-on-write (software bit)
+#define PTE_SHARED      0x400   // MAP_SHARED page, never copied (software bit)
 
 // Address in page table or page directory entry
 #define PTE_ADDR(pte)   ((uint)(pte) & ~0xFFF)
+#define PTE_FLAGS(pte)  ((uint)(pte) &  0xFFF)
 
-#ifndef __ASSEMBLER__
-typedef uint pte_t;
+// Page fault error code bits, in tf->err for T_PGFLT
+#define FEC_PR          0x1     // Fault on a present page
+#define FEC_WR          0x2     // Fault caused by a write
+#define FEC_U           0x4     // Fault in user mode
 
+#ifndef __ASSEMBLER__
 // Task state segment format
 struct taskstate {
   uint link;         // Old ts selector
@@ -0,0 +1,28 @@
+#include "types.h"
+#include "stat.h"
+#include "user.h"
+
+// Run a command with a different nice value, for example
+// to keep a bulk writer from slowing down the shell.
+int
+main(int argc, char **argv)
+{
+  int n;
+
+  if(argc < 3){
+    printf(2, "usage: nice n command [arg...]\n");
+    exit();
+  }
+  // atoi() does not take a sign.
+  if(argv[1][0] == '-')
+    n = -atoi(argv[1] + 1);
+  else
+    n = atoi(argv[1]);
+  if(setpriority(0, n) < 0){
+    printf(2, "nice: bad nice value %s\n", argv[1]);
+    exit();
+  }
+  exec(argv[2], argv + 2);
+  printf(2, "nice: exec %s failed\n", argv[2]);
+  exit();
+}
@@ -1,12 +1,16 @@
-#define NPROC        64  // maximum number of processes
+#define NPROC       256  // maximum number of processes
 #define KSTACKSIZE 4096  // size of per-process kernel stack
 #define NCPU          8  // maximum number of CPUs
 #define NOFILE       16  // open files per process
-#define NFILE       100  // open files per system
-#define NBUF         10  // size of disk block cache
-#define NINODE       50  // maximum number of active i-nodes
+#define NBUF         10  // buffers the disk block cache keeps
 #define NDEV         10  // maximum major device number
 #define ROOTDEV       1  // device number of file system root disk
 #define MAXARG       32  // max exec arguments
-#define LOGSIZE      10  // max data sectors in on-disk log
+#define MAXIOV       16  // max buffers per readv/writev
+#define NVMA          8  // mmap regions per process
+#define NPCACHE     128  // file pages cached for sharing between processes
+#define LOGSIZE      30  // max data sectors in on-disk log
+#define NLOCKSTAT    64  // locks whose statistics lockstat() reports
+#define NICEMIN     -20  // nice value getting the most CPU
+#define NICEMAX      19  // nice value getting the least CPU
 
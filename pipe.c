@@ -3,21 +3,31 @@
 #include "param.h"
 #include "mmu.h"
 #include "proc.h"
+#include "stat.h"
 #include "fs.h"
 #include "file.h"
+#include "fcntl.h"
 #include "spinlock.h"
 
-#define PIPESIZE 512
-
+// A pipe occupies one kalloc() page: this header, with the
+// rest of the page as the data ring.
 struct pipe {
   struct spinlock lock;
-  char data[PIPESIZE];
   uint nread;     // number of bytes read
   uint nwrite;    // number of bytes written
   int readopen;   // read fd is still open
   int writeopen;  // write fd is still open
+  int readwait;   // a reader is sleeping on nread
+  int writewait;  // a writer is sleeping on nwrite
+  char data[];
 };
 
+#define PIPESIZE (PGSIZE - sizeof(struct pipe))
+
+// A writer blocked on a full pipe is woken only once this
+// much of the ring is free, rather than after every read.
+#define PIPEWAKE (PIPESIZE / 2)
+
 int
 pipealloc(struct file **f0, struct file **f1)
 {
@@ -33,6 +43,8 @@ pipealloc(struct file **f0, struct file **f1)
   p->writeopen = 1;
   p->nwrite = 0;
   p->nread = 0;
+  p->readwait = 0;
+  p->writewait = 0;
   initlock(&p->lock, "pipe");
   (*f0)->type = FD_PIPE;
   (*f0)->readable = 1;
@@ -74,32 +86,103 @@ pipeclose(struct pipe *p, int writable)
 }
 
 //PAGEBREAK: 40
+// Copy up to n bytes from addr into the ring, as many as
+// fit.  Caller holds p->lock.
+static uint
+pipein(struct pipe *p, char *addr, uint n)
+{
+  uint i, m, off;
+
+  for(i = 0; i < n && p->nwrite != p->nread + PIPESIZE; i += m){
+    // Copy as much as fits before the ring wraps.
+    off = p->nwrite % PIPESIZE;
+    m = n - i;
+    if(m > PIPESIZE - (p->nwrite - p->nread))
+      m = PIPESIZE - (p->nwrite - p->nread);
+    if(m > PIPESIZE - off)
+      m = PIPESIZE - off;
+    memmove(p->data + off, addr + i, m);
+    p->nwrite += m;
+  }
+  return i;
+}
+
+// Copy up to n bytes out of the ring to addr, as many as
+// there are.  Caller holds p->lock.
+static uint
+pipeout(struct pipe *p, char *addr, uint n)
+{
+  uint i, m, off;
+
+  for(i = 0; i < n && p->nread != p->nwrite; i += m){  //DOC: piperead-copy
+    off = p->nread % PIPESIZE;
+    m = n - i;
+    if(m > p->nwrite - p->nread)
+      m = p->nwrite - p->nread;
+    if(m > PIPESIZE - off)
+      m = PIPESIZE - off;
+    memmove(addr + i, p->data + off, m);
+    p->nread += m;
+  }
+  // PIPESIZE is not a power of two, so keep the counters
+  // from wrapping around and breaking the % above.
+  if(p->nread >= PIPESIZE){
+    p->nread -= PIPESIZE;
+    p->nwrite -= PIPESIZE;
+  }
+  return i;
+}
+
+// Wake readers of p, if any are sleeping.
+static void
+pipewakeread(struct pipe *p)
+{
+  if(p->readwait){
+    p->readwait = 0;
+    wakeup(&p->nread);
+  }
+}
+
+// Wake writers of p once there is enough room for them.
+static void
+pipewakewrite(struct pipe *p)
+{
+  if(p->writewait && PIPESIZE - (p->nwrite - p->nread) >= PIPEWAKE){
+    p->writewait = 0;
+    wakeup(&p->nwrite);
+  }
+}
+
 int
 pipewrite(struct pipe *p, char *addr, int n)
 {
   int i;
 
   acquire(&p->lock);
-  for(i = 0; i < n; i++){
+  i = 0;
+  while(i < n){
     while(p->nwrite == p->nread + PIPESIZE){  //DOC: pipewrite-full
       if(p->readopen == 0 || proc->killed){
         release(&p->lock);
         return -1;
       }
-      wakeup(&p->nread);
+      pipewakeread(p);
+      p->writewait = 1;
       sleep(&p->nwrite, &p->lock);  //DOC: pipewrite-sleep
     }
-    p->data[p->nwrite++ % PIPESIZE] = addr[i];
+    i += pipein(p, addr + i, n - i);
   }
-  wakeup(&p->nread);  //DOC: pipewrite-wakeup1
+  pipewakeread(p);  //DOC: pipewrite-wakeup1
   release(&p->lock);
   return n;
 }
 
+// Read into the iovcnt buffers of iov.  Waits only until
+// the pipe is non-empty, then copies what is there.
 int
-piperead(struct pipe *p, char *addr, int n)
+pipereadv(struct pipe *p, struct iovec *iov, int iovcnt)
 {
-  int i;
+  int i, j, tot;
 
   acquire(&p->lock);
   while(p->nread == p->nwrite && p->writeopen){  //DOC: pipe-empty
@@ -107,14 +190,108 @@ piperead(struct pipe *p, char *addr, int n)
       release(&p->lock);
       return -1;
     }
+    p->readwait = 1;
     sleep(&p->nread, &p->lock); //DOC: piperead-sleep
   }
-  for(i = 0; i < n; i++){  //DOC: piperead-copy
-    if(p->nread == p->nwrite)
+  tot = 0;
+  for(j = 0; j < iovcnt; j++){
+    i = pipeout(p, iov[j].iov_base, iov[j].iov_len);
+    tot += i;
+    if(i < iov[j].iov_len)
       break;
-    addr[i] = p->data[p->nread++ % PIPESIZE];
   }
-  wakeup(&p->nwrite);  //DOC: piperead-wakeup
+  pipewakewrite(p);  //DOC: piperead-wakeup
   release(&p->lock);
-  return i;
+  return tot;
+}
+
+int
+piperead(struct pipe *p, char *addr, int n)
+{
+  struct iovec iov;
+
+  iov.iov_base = addr;
+  iov.iov_len = n;
+  return pipereadv(p, &iov, 1);
+}
+
+// The rest of this file lets splice() move data between a pipe
+// and the buffer cache without sleeping in the middle of the
+// copy, which would hold a locked inode and buffer while the
+// other end of the pipe might need them.
+
+// Wait until there is room to write to p.  Returns -1 if the
+// read end is closed.
+int
+pipewaitwrite(struct pipe *p)
+{
+  acquire(&p->lock);
+  while(p->readopen && p->nwrite == p->nread + PIPESIZE){
+    if(proc->killed){
+      release(&p->lock);
+      return -1;
+    }
+    pipewakeread(p);
+    p->writewait = 1;
+    sleep(&p->nwrite, &p->lock);
+  }
+  if(p->readopen == 0){
+    release(&p->lock);
+    return -1;
+  }
+  release(&p->lock);
+  return 0;
+}
+
+// Wait until there is data to read from p.  Returns 1 if
+// there is, 0 at end of file.
+int
+pipewaitread(struct pipe *p)
+{
+  int r;
+
+  acquire(&p->lock);
+  while(p->nread == p->nwrite && p->writeopen){
+    if(proc->killed){
+      release(&p->lock);
+      return -1;
+    }
+    p->readwait = 1;
+    sleep(&p->nread, &p->lock);
+  }
+  r = p->nread != p->nwrite;
+  release(&p->lock);
+  return r;
+}
+
+// Copy up to n bytes into p without sleeping.
+// Returns the number copied, or -1 if the read end is closed.
+int
+pipeput(struct pipe *p, char *addr, int n)
+{
+  int r;
+
+  acquire(&p->lock);
+  if(p->readopen == 0){
+    release(&p->lock);
+    return -1;
+  }
+  r = pipein(p, addr, n);
+  pipewakeread(p);
+  release(&p->lock);
+  return r;
+}
+
+// Copy up to n bytes out of p without sleeping.
+// Returns the number copied.
+int
+pipeget(struct pipe *p, char *addr, int n)
+{
+  int r;
+
+  acquire(&p->lock);
+  r = pipeout(p, addr, n);
+  pipewakewrite(p);
+  release(&p->lock);
+  return r;
 }
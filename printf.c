@@ -1,11 +1,76 @@
 #include "types.h"
 #include "stat.h"
+#include "param.h"
 #include "user.h"
 
+// Output buffering, per file descriptor.  The mode is chosen
+// the first time printf writes to an fd:
+//   fd 2 is unbuffered: each printf() is one write().
+//   a console (T_DEV) is line buffered.
+//   anything else (files, pipes) is fully buffered.
+// Buffers are flushed when full, by fflush(), and by the
+// fork/exec/close/exit wrappers in ulib.c.
+#define OBUF_UNBUF  1
+#define OBUF_LINE   2
+#define OBUF_FULL   3
+
+static struct {
+  int mode;
+  int n;
+  char buf[512];
+} obuf[NOFILE];
+
+static int
+bufmode(int fd)
+{
+  struct stat st;
+
+  if(fd == 2)
+    return OBUF_UNBUF;
+  if(fstat(fd, &st) == 0 && st.type == T_DEV)
+    return OBUF_LINE;
+  return OBUF_FULL;
+}
+
+// Write out fd's buffered output, or every fd's if fd < 0.
+void
+fflush(int fd)
+{
+  if(fd < 0){
+    for(fd = 0; fd < NOFILE; fd++)
+      fflush(fd);
+    return;
+  }
+  if(fd >= NOFILE || obuf[fd].n == 0)
+    return;
+  write(fd, obuf[fd].buf, obuf[fd].n);
+  obuf[fd].n = 0;
+}
+
+// Flush fd and forget its mode; fd is about to be closed
+// and may be reused for a different kind of file.
+void
+bufclose(int fd)
+{
+  if(fd < 0 || fd >= NOFILE)
+    return;
+  fflush(fd);
+  obuf[fd].mode = 0;
+}
+
 static void
 putc(int fd, char c)
 {
-  write(fd, &c, 1);
+  if(fd < 0 || fd >= NOFILE){
+    write(fd, &c, 1);
+    return;
+  }
+  if(obuf[fd].mode == 0)
+    obuf[fd].mode = bufmode(fd);
+  obuf[fd].buf[obuf[fd].n++] = c;
+  if(obuf[fd].n == sizeof(obuf[fd].buf) ||
+     (c == '\n' && obuf[fd].mode == OBUF_LINE))
+    fflush(fd);
 }
 
 static void
@@ -82,4 +147,6 @@ printf(int fd, char *fmt, ...)
       state = 0;
     }
   }
+  if(fd >= 0 && fd < NOFILE && obuf[fd].mode == OBUF_UNBUF)
+    fflush(fd);
 }
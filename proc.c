@@ -7,9 +7,36 @@
 #include "proc.h"
 #include "spinlock.h"
 
+// Each CPU has a queue of the RUNNABLE processes waiting for
+// it, ordered by the scheduling policy.  A process that
+// becomes RUNNABLE joins the queue of the CPU it last ran on,
+// whose cache is most likely to still hold its memory; a CPU
+// whose queue is empty takes a process from the longest queue
+// of another CPU.  The queues are protected by ptable.lock,
+// like the rest of the process state, but an idle CPU only
+// looks at their lengths, and takes no lock, until there is
+// something to run.  Meanwhile it halts, with its timer
+// stopped unless it is the CPU that counts ticks, and
+// setrunnable() sends it an interrupt when there is work.
+// Live processes are hashed by pid, and the UNUSED slots
+// are kept on a free list, so neither kill() nor allocproc()
+// scans the table.
+#define NPIDHASH 64
+#define PIDHASH(pid) ((uint)(pid) % NPIDHASH)
+
+// Sleeping processes are kept in wait queues hashed by their
+// channel, so that wakeup() only looks at processes that may
+// be sleeping on the channel it was given.
+#define NCHAN 61
+#define CHASH(chan) ((uint)(chan) % NCHAN)
+
 struct {
   struct spinlock lock;
   struct proc proc[NPROC];
+  struct runq rq[NCPU];        // indexed like cpus[]
+  struct proc *chan[NCHAN];    // wait queues, through cnext
+  struct proc *pid[NPIDHASH];  // live processes, through hnext
+  struct proc *free;           // UNUSED slots, through hnext
 } ptable;
 
 static struct proc *initproc;
@@ -23,12 +50,179 @@ static void wakeup1(void *chan);
 void
 pinit(void)
 {
+  struct proc *p;
+
   initlock(&ptable.lock, "ptable");
+  for(p = &ptable.proc[NPROC-1]; p >= ptable.proc; p--){
+    p->hnext = ptable.free;
+    ptable.free = p;
+  }
+}
+
+// Return the live process with the given pid, or 0.
+// The ptable lock must be held.
+static struct proc*
+findproc(int pid)
+{
+  struct proc *p;
+
+  for(p = ptable.pid[PIDHASH(pid)]; p; p = p->hnext)
+    if(p->pid == pid)
+      return p;
+  return 0;
+}
+
+// Unhash p and return its slot to the free list.
+// The ptable lock must be held.
+static void
+freeproc(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &ptable.pid[PIDHASH(p->pid)]; *pp != p; pp = &(*pp)->hnext)
+    if(*pp == 0)
+      panic("freeproc");
+  *pp = p->hnext;
+  p->state = UNUSED;
+  p->pid = 0;
+  p->hnext = ptable.free;
+  ptable.free = p;
+}
+
+// May p run on CPU c (an index into cpus[])?
+#define ALLOWED(p, c) ((p)->affinity & (1 << (c)))
+
+// p was queued for its CPU.  If that CPU is halted, wake it;
+// if it is busy, wake some idle CPU that may steal p.
+// The ptable lock must be held.
+static void
+kick(struct proc *p)
+{
+  struct cpu *t;
+
+  t = &cpus[p->cpu];
+  if(!t->idle){
+    for(t = cpus; t < &cpus[ncpu]; t++)
+      if(t->idle && ALLOWED(p, t - cpus))
+        break;
+    if(t == &cpus[ncpu])
+      return;
+  }
+  // A CPU waking from an interrupt handler it took while
+  // idle will look at the queues anyway.
+  if(t != cpu)
+    lapicwakeup(t->id);
+}
+
+// Make p RUNNABLE and add it to its CPU's queue.  If its
+// affinity no longer allows that CPU, use the allowed CPU
+// with the shortest queue.
+// The ptable lock must be held.
+static void
+setrunnable(struct proc *p)
+{
+  int c;
+
+  if(!ALLOWED(p, p->cpu)){
+    for(c = 0; c < ncpu; c++)
+      if(ALLOWED(p, c) && (!ALLOWED(p, p->cpu) ||
+         ptable.rq[c].n < ptable.rq[p->cpu].n))
+        p->cpu = c;
+  }
+  p->state = RUNNABLE;
+  schedpolicy->enqueue(&ptable.rq[p->cpu], p);
+  kick(p);
+}
+
+// Remove RUNNABLE process p from its run queue.
+// The ptable lock must be held.
+static void
+unqueue(struct proc *p)
+{
+  struct runq *q;
+  struct proc **pp, *prev;
+
+  q = &ptable.rq[p->cpu];
+  prev = 0;
+  for(pp = &q->head; *pp; pp = &(*pp)->rqnext){
+    if(*pp == p){
+      *pp = p->rqnext;
+      if(q->tail == p)
+        q->tail = prev;
+      q->n--;
+      p->rqnext = 0;
+      return;
+    }
+    prev = *pp;
+  }
+  panic("unqueue");
+}
+
+// Remove sleeping process p from its wait queue.
+// The ptable lock must be held.
+static void
+unchain(struct proc *p)
+{
+  struct proc **pp;
+
+  for(pp = &ptable.chan[CHASH(p->chan)]; *pp; pp = &(*pp)->cnext){
+    if(*pp == p){
+      *pp = p->cnext;
+      p->cnext = 0;
+      return;
+    }
+  }
+  panic("unchain");
+}
+
+// Return the longest run queue of another CPU, or 0 if
+// they are all empty.  Reads the lengths without a lock,
+// so the answer is only a hint.
+static struct runq*
+busiest(struct runq *self)
+{
+  struct runq *q, *best;
+
+  best = 0;
+  for(q = ptable.rq; q < &ptable.rq[ncpu]; q++)
+    if(q != self && q->n > 0 && (best == 0 || q->n > best->n))
+      best = q;
+  return best;
+}
+
+// Find a process on another CPU's queue that may run on
+// this one, preferring the longest queue, and take it off
+// that queue if take is set.  Returns 0 if there is none.
+// The ptable lock must be held.
+static struct proc*
+steal(int take)
+{
+  struct runq *q, *best;
+  struct proc *p, *found;
+  int c;
+
+  c = cpu - cpus;
+  best = 0;
+  found = 0;
+  for(q = ptable.rq; q < &ptable.rq[ncpu]; q++){
+    if(q == &ptable.rq[c] || (best && q->n <= best->n))
+      continue;
+    for(p = q->head; p; p = p->rqnext){
+      if(ALLOWED(p, c)){
+        best = q;
+        found = p;
+        break;
+      }
+    }
+  }
+  if(found && take)
+    unqueue(found);
+  return found;
 }
 
 //PAGEBREAK: 32
-// Look in the process table for an UNUSED proc.
-// If found, change state to EMBRYO and initialize
+// Take an UNUSED proc from the free list.
+// If there is one, change state to EMBRYO and initialize
 // state required to run in the kernel.
 // Otherwise return 0.
 static struct proc*
@@ -38,20 +232,29 @@ allocproc(void)
   char *sp;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == UNUSED)
-      goto found;
-  release(&ptable.lock);
-  return 0;
-
-found:
+  if((p = ptable.free) == 0){
+    release(&ptable.lock);
+    return 0;
+  }
+  ptable.free = p->hnext;
   p->state = EMBRYO;
   p->pid = nextpid++;
+  p->hnext = ptable.pid[PIDHASH(p->pid)];
+  ptable.pid[PIDHASH(p->pid)] = p;
+  p->children = 0;
+  p->zombies = 0;
+  p->affinity = ~0;
+  p->nice = 0;
+  p->vruntime = 0;
+  p->slice = 0;
+  p->used = 0;
   release(&ptable.lock);
 
   // Allocate kernel stack.
   if((p->kstack = kalloc()) == 0){
-    p->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(p);
+    release(&ptable.lock);
     return 0;
   }
   sp = p->kstack + KSTACKSIZE;
@@ -99,10 +302,14 @@ userinit(void)
   safestrcpy(p->name, "initcode", sizeof(p->name));
   p->cwd = namei("/");
 
-  p->state = RUNNABLE;
+  acquire(&ptable.lock);
+  setrunnable(p);
+  release(&ptable.lock);
 }
 
 // Grow current process's memory by n bytes.
+// Growing only reserves the addresses: pagefault()
+// allocates each page when it is first touched.
 // Return 0 on success, -1 on failure.
 int
 growproc(int n)
@@ -111,8 +318,9 @@ growproc(int n)
   
   sz = proc->sz;
   if(n > 0){
-    if((sz = allocuvm(proc->pgdir, sz, sz + n)) == 0)
+    if(sz + n < sz || sz + n > mmaplimit(proc))
       return -1;
+    sz += n;
   } else if(n < 0){
     if((sz = deallocuvm(proc->pgdir, sz, sz + n)) == 0)
       return -1;
@@ -124,7 +332,7 @@ growproc(int n)
 
 // Create a new process copying p as the parent.
 // Sets up stack to return as if from system call.
-// Caller must set state of returned proc to RUNNABLE.
+// The child joins the run queue of the parent's CPU.
 int
 fork(void)
 {
@@ -136,13 +344,19 @@ fork(void)
     return -1;
 
   // Copy process state from p.
-  if((np->pgdir = copyuvm(proc->pgdir, proc->sz)) == 0){
+  np->pgdir = copyuvm(proc->pgdir);
+  // copyuvm made the parent's writable pages copy-on-write.
+  lcr3(v2p(proc->pgdir));
+  if(np->pgdir == 0){
     kfree(np->kstack);
     np->kstack = 0;
-    np->state = UNUSED;
+    acquire(&ptable.lock);
+    freeproc(np);
+    release(&ptable.lock);
     return -1;
   }
   np->sz = proc->sz;
+  mmapfork(np, proc);
   np->parent = proc;
   *np->tf = *proc->tf;
 
@@ -155,8 +369,19 @@ fork(void)
   np->cwd = idup(proc->cwd);
  
   pid = np->pid;
-  np->state = RUNNABLE;
   safestrcpy(np->name, proc->name, sizeof(proc->name));
+  np->cpu = proc->cpu;
+  np->affinity = proc->affinity;
+  np->nice = proc->nice;
+  np->vruntime = proc->vruntime;
+  acquire(&ptable.lock);
+  np->sibprev = 0;
+  np->sibnext = proc->children;
+  if(proc->children)
+    proc->children->sibprev = np;
+  proc->children = np;
+  setrunnable(np);
+  release(&ptable.lock);
   return pid;
 }
 
@@ -172,6 +397,9 @@ exit(void)
   if(proc == initproc)
     panic("init exiting");
 
+  // Write back and drop mmap() regions while the files are open.
+  mmapclear(proc);
+
   // Close all open files.
   for(fd = 0; fd < NOFILE; fd++){
     if(proc->ofile[fd]){
@@ -186,15 +414,31 @@ exit(void)
   acquire(&ptable.lock);
 
   // Parent might be sleeping in wait().
+  proc->znext = proc->parent->zombies;
+  proc->parent->zombies = proc;
   wakeup1(proc->parent);
 
-  // Pass abandoned children to init.
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->parent == proc){
+  // Pass abandoned children, and those of them already
+  // waiting to be reaped, to init.
+  if(proc->children){
+    for(p = proc->children; ; p = p->sibnext){
       p->parent = initproc;
-      if(p->state == ZOMBIE)
-        wakeup1(initproc);
+      if(p->sibnext == 0)
+        break;
     }
+    p->sibnext = initproc->children;
+    if(initproc->children)
+      initproc->children->sibprev = p;
+    initproc->children = proc->children;
+    proc->children = 0;
+  }
+  if(proc->zombies){
+    for(p = proc->zombies; p->znext; p = p->znext)
+      ;
+    p->znext = initproc->zombies;
+    initproc->zombies = proc->zombies;
+    proc->zombies = 0;
+    wakeup1(initproc);
   }
 
   // Jump into the scheduler, never to return.
@@ -209,34 +453,33 @@ int
 wait(void)
 {
   struct proc *p;
-  int havekids, pid;
+  int pid;
 
   acquire(&ptable.lock);
   for(;;){
-    // Scan through table looking for zombie children.
-    havekids = 0;
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->parent != proc)
-        continue;
-      havekids = 1;
-      if(p->state == ZOMBIE){
-        // Found one.
-        pid = p->pid;
-        kfree(p->kstack);
-        p->kstack = 0;
-        freevm(p->pgdir);
-        p->state = UNUSED;
-        p->pid = 0;
-        p->parent = 0;
-        p->name[0] = 0;
-        p->killed = 0;
-        release(&ptable.lock);
-        return pid;
-      }
+    // Take a child off the list of those that have exited.
+    if((p = proc->zombies) != 0){
+      proc->zombies = p->znext;
+      if(p->sibprev)
+        p->sibprev->sibnext = p->sibnext;
+      else
+        proc->children = p->sibnext;
+      if(p->sibnext)
+        p->sibnext->sibprev = p->sibprev;
+      pid = p->pid;
+      kfree(p->kstack);
+      p->kstack = 0;
+      freevm(p->pgdir);
+      freeproc(p);
+      p->parent = 0;
+      p->name[0] = 0;
+      p->killed = 0;
+      release(&ptable.lock);
+      return pid;
     }
 
     // No point waiting if we don't have any children.
-    if(!havekids || proc->killed){
+    if(proc->children == 0 || proc->killed){
       release(&ptable.lock);
       return -1;
     }
@@ -249,13 +492,12 @@ wait(void)
 void
 register_handler(sighandler_t sighandler)
 {
-  char* addr = uva2ka(proc->pgdir, (char*)proc->tf->esp);
   if ((proc->tf->esp & 0xFFF) == 0)
     panic("esp_offset == 0");
 
-    /* open a new frame */
-  *(int*)(addr + ((proc->tf->esp - 4) & 0xFFF))
-          = proc->tf->eip;
+    /* open a new frame; copyout() unshares a copy-on-write stack */
+  if (copyout(proc->pgdir, proc->tf->esp - 4, &proc->tf->eip, 4) < 0)
+    panic("register_handler");
   proc->tf->esp -= 4;
 
     /* update eip */
@@ -275,32 +517,62 @@ void
 scheduler(void)
 {
   struct proc *p;
+  struct runq *q;
+  int empty;
 
+  q = &ptable.rq[cpu - cpus];
   for(;;){
     // Enable interrupts on this processor.
     sti();
 
-    // Loop over process table looking for process to run.
-    acquire(&ptable.lock);
-    for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-      if(p->state != RUNNABLE)
-        continue;
-
-      // Switch to chosen process.  It is the process's job
-      // to release ptable.lock and then reacquire it
-      // before jumping back to us.
-      proc = p;
-      switchuvm(p);
-      p->state = RUNNING;
-      swtch(&cpu->scheduler, proc->context);
-      switchkvm();
-
-      // Process is done running for now.
-      // It should have changed its p->state before coming back.
-      proc = 0;
+    // Take the next process from this CPU's queue, or
+    // steal one that may run here from the busiest other CPU.
+    p = 0;
+    if(q->n > 0 || busiest(q)){
+      acquire(&ptable.lock);
+      if((p = schedpolicy->dequeue(q)) == 0)
+        p = steal(1);
+      if(p){
+        // Switch to chosen process.  It is the process's job
+        // to release ptable.lock and then reacquire it
+        // before jumping back to us.
+        p->cpu = cpu - cpus;
+        proc = p;
+        switchuvm(p);
+        p->state = RUNNING;
+        swtch(&cpu->scheduler, proc->context);
+        switchkvm();
+
+        // Process is done running for now.
+        // It should have changed its p->state before coming back.
+        proc = 0;
+      }
+      release(&ptable.lock);
     }
-    release(&ptable.lock);
+    if(p)
+      continue;
 
+    // Nothing to run: use the time to zero free pages, and
+    // when there are none left to zero, halt.  The queues are
+    // checked again under ptable.lock after announcing the
+    // CPU idle, so a process queued after that check will
+    // see cpu->idle and kick() will interrupt the halt.
+    if(kzero())
+      continue;
+    cli();
+    acquire(&ptable.lock);
+    cpu->idle = 1;
+    empty = q->n == 0 && steal(0) == 0;
+    release(&ptable.lock);
+    if(empty){
+      if(cpu->id != 0)
+        lapictimer(0);
+      stihlt();
+      cli();
+      if(cpu->id != 0)
+        lapictimer(1);
+    }
+    cpu->idle = 0;
   }
 }
 
@@ -329,11 +601,62 @@ void
 yield(void)
 {
   acquire(&ptable.lock);  //DOC: yieldlock
-  proc->state = RUNNABLE;
+  setrunnable(proc);
   sched();
   release(&ptable.lock);
 }
 
+// Set the nice value of process pid, or of the caller if
+// pid is 0.  It takes effect the next time the process
+// is queued.
+int
+setpriority(int pid, int nice)
+{
+  struct proc *p;
+
+  if(nice < NICEMIN || nice > NICEMAX)
+    return -1;
+  if(pid == 0)
+    pid = proc->pid;
+  acquire(&ptable.lock);
+  if((p = findproc(pid)) == 0){
+    release(&ptable.lock);
+    return -1;
+  }
+  p->nice = nice;
+  release(&ptable.lock);
+  return 0;
+}
+
+// Restrict process pid, or the caller if pid is 0, to the
+// CPUs whose bits are set in mask.  A queued process moves
+// at once, the caller by yielding, and any other running
+// process when it is next preempted.
+int
+setaffinity(int pid, uint mask)
+{
+  struct proc *p;
+
+  if((mask & ((1 << ncpu) - 1)) == 0)
+    return -1;
+  if(pid == 0)
+    pid = proc->pid;
+  acquire(&ptable.lock);
+  if((p = findproc(pid)) == 0){
+    release(&ptable.lock);
+    return -1;
+  }
+  p->affinity = mask;
+  if(p->state == RUNNABLE && !ALLOWED(p, p->cpu)){
+    unqueue(p);
+    setrunnable(p);
+  }
+  release(&ptable.lock);
+  if(p == proc && !ALLOWED(p, p->cpu))
+    yield();
+  return 0;
+}
+
 // A fork child's very first scheduling by scheduler()
 // will swtch here.  "Return" to user space.
 void
@@ -378,6 +701,8 @@ sleep(void *chan, struct spinlock *lk)
 
   // Go to sleep.
   proc->chan = chan;
+  proc->cnext = ptable.chan[CHASH(chan)];
+  ptable.chan[CHASH(chan)] = proc;
   proc->state = SLEEPING;
   sched();
 
@@ -397,11 +722,17 @@ sleep(void *chan, struct spinlock *lk)
 static void
 wakeup1(void *chan)
 {
-  struct proc *p;
-
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++)
-    if(p->state == SLEEPING && p->chan == chan)
-      p->state = RUNNABLE;
+  struct proc *p, **pp;
+
+  pp = &ptable.chan[CHASH(chan)];
+  while((p = *pp) != 0){
+    if(p->chan == chan){
+      *pp = p->cnext;
+      p->cnext = 0;
+      setrunnable(p);
+    } else
+      pp = &p->cnext;
+  }
 }
 
 // Wake up all processes sleeping on chan.
@@ -422,18 +753,18 @@ kill(int pid)
   struct proc *p;
 
   acquire(&ptable.lock);
-  for(p = ptable.proc; p < &ptable.proc[NPROC]; p++){
-    if(p->pid == pid){
-      p->killed = 1;
-      // Wake process from sleep if necessary.
-      if(p->state == SLEEPING)
-        p->state = RUNNABLE;
-      release(&ptable.lock);
-      return 0;
-    }
+  if((p = findproc(pid)) == 0){
+    release(&ptable.lock);
+    return -1;
+  }
+  p->killed = 1;
+  // Wake process from sleep if necessary.
+  if(p->state == SLEEPING){
+    unchain(p);
+    setrunnable(p);
   }
   release(&ptable.lock);
-  return -1;
+  return 0;
 }
 
 //PAGEBREAK: 36
@@ -10,6 +10,7 @@ struct cpu {
   volatile uint started;        // Has the CPU started?
   int ncli;                    // Depth of pushcli nesting.
   int intena;                  // Were interrupts enabled before pushcli?
+  volatile int idle;           // Halted in scheduler() with nothing to run?
   
   // Cpu-local storage variables; see below
   struct cpu *cpu;
@@ -51,8 +52,41 @@ struct context {
 
 enum procstate { UNUSED, EMBRYO, SLEEPING, RUNNABLE, RUNNING, ZOMBIE };
 
+// The RUNNABLE processes waiting for one CPU, in the order
+// the scheduling policy will run them.
+struct runq {
+  struct proc *head;           // through rqnext
+  struct proc *tail;
+  volatile int n;
+  uint vmin;                   // Least vruntime run here so far
+};
+
+// A scheduling policy orders run queues and decides when the
+// timer preempts a process; see sched.c.
+struct schedpolicy {
+  char *name;
+  void (*enqueue)(struct runq*, struct proc*);
+  struct proc* (*dequeue)(struct runq*);
+  int (*tick)(struct proc*);   // Charge a tick; 1 to preempt
+};
+
+extern struct schedpolicy *schedpolicy;
+
 typedef void (*sighandler_t)(void);
 
+// A region of the address space mapped from a file, by mmap()
+// or for a program segment by exec().  Pages are read in from
+// the file on first touch.
+struct vma {
+  uint addr;                   // Start, page-aligned
+  uint len;                    // Length, a multiple of PGSIZE
+  uint off;                    // File offset mapped at addr
+  uint flen;                   // Bytes backed by the file; the rest is zero
+  int prot;                    // PROT_READ, PROT_WRITE
+  int flags;                   // MAP_SHARED or MAP_PRIVATE
+  struct file *f;              // Backing file; 0 if the slot is free
+};
+
 // Per-process state
 struct proc {
   uint sz;                     // Size of process memory (bytes)
@@ -60,7 +94,13 @@ struct proc {
   char *kstack;                // Bottom of kernel stack for this process
   enum procstate state;        // Process state
   volatile int pid;            // Process ID
+  struct proc *hnext;          // PID hash chain, or free list if UNUSED
   struct proc *parent;         // Parent process
+  struct proc *children;       // Children, through sibnext/sibprev
+  struct proc *sibnext;
+  struct proc *sibprev;
+  struct proc *zombies;        // Children that have exited, through znext
+  struct proc *znext;
   struct trapframe *tf;        // Trap frame for current syscall
   struct context *context;     // swtch() here to run process
   void *chan;                  // If non-zero, sleeping on chan
@@ -68,6 +108,15 @@ struct proc {
   struct file *ofile[NOFILE];  // Open files
   struct inode *cwd;           // Current directory
   char name[16];               // Process name (debugging)
+  struct vma vma[NVMA];        // mmap() regions
+  int cpu;                     // Run queue to use; the CPU it last ran on
+  uint affinity;               // Bit c set if it may run on cpus[c]
+  struct proc *rqnext;         // Next on that run queue, if RUNNABLE
+  int nice;                    // NICEMIN (most CPU) to NICEMAX (least)
+  uint vruntime;               // Weighted ticks run, for fair share
+  int slice;                   // Ticks it may run before preemption
+  int used;                    // Ticks of the slice used so far
+  struct proc *cnext;          // Next sleeper in the same wait queue
 };
 
 // Process memory is laid out contiguously, low addresses first:
@@ -75,3 +124,5 @@ struct proc {
 //   original data and bss
 //   fixed-size stack
 //   expandable heap
+//   ...
+//   mmap() regions, allocated downwards from KERNBASE
@@ -0,0 +1,137 @@
+// Scheduling policies.
+//
+// A policy decides the order of the processes on a run queue
+// and when the timer preempts the running process.  proc.c
+// calls it through schedpolicy, with ptable.lock held for
+// enqueue and dequeue; tick is called from the timer
+// interrupt for the process it interrupted.
+//
+// rrpolicy is plain round robin: FIFO queues, a new choice on
+// every tick.
+//
+// fairpolicy shares each CPU among its processes in proportion
+// to their weights, which nice sets.  A process's vruntime
+// grows by every tick it runs, scaled down by its weight, and
+// the queue is kept sorted so the process that has had the
+// least is chosen next.  A process that runs a whole slice
+// without blocking is CPU-bound and gets twice as long a slice
+// next time, up to MAXSLICE ticks; one that blocks goes back
+// to a one-tick slice.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "proc.h"
+
+#define MAXSLICE 8
+
+// Weight of each nice value, from NICEMIN to NICEMAX.
+// Each step is worth about 10% of the CPU.
+static int weight[] = {
+  88761, 71755, 56483, 46273, 36291,
+  29154, 23254, 18705, 14949, 11916,
+   9548,  7620,  6100,  4904,  3906,
+   3121,  2501,  1991,  1586,  1277,
+   1024,   820,   655,   526,   423,
+    335,   272,   215,   172,   137,
+    110,    87,    70,    56,    45,
+     36,    29,    23,    18,    15,
+};
+
+// Is vruntime a before b?  Compared as a difference, so
+// that it keeps working when the counters wrap.
+#define BEFORE(a, b) ((int)((a) - (b)) < 0)
+
+static void
+rrenqueue(struct runq *q, struct proc *p)
+{
+  p->rqnext = 0;
+  if(q->tail)
+    q->tail->rqnext = p;
+  else
+    q->head = p;
+  q->tail = p;
+  q->n++;
+}
+
+static struct proc*
+rrdequeue(struct runq *q)
+{
+  struct proc *p;
+
+  if((p = q->head) == 0)
+    return 0;
+  q->head = p->rqnext;
+  if(q->head == 0)
+    q->tail = 0;
+  q->n--;
+  p->rqnext = 0;
+  return p;
+}
+
+static int
+rrtick(struct proc *p)
+{
+  return 1;
+}
+
+struct schedpolicy rrpolicy = {
+  "round robin",
+  rrenqueue,
+  rrdequeue,
+  rrtick,
+};
+
+static void
+fairenqueue(struct runq *q, struct proc *p)
+{
+  struct proc **pp;
+
+  // A process that has been asleep or is new must not
+  // bank the time it was away: it starts level with the
+  // process that has had the least CPU on this queue.
+  if(BEFORE(p->vruntime, q->vmin))
+    p->vruntime = q->vmin;
+
+  if(p->slice && p->used >= p->slice)
+    p->slice = p->slice*2 > MAXSLICE ? MAXSLICE : p->slice*2;
+  else
+    p->slice = 1;
+  p->used = 0;
+
+  for(pp = &q->head; *pp; pp = &(*pp)->rqnext)
+    if(BEFORE(p->vruntime, (*pp)->vruntime))
+      break;
+  p->rqnext = *pp;
+  *pp = p;
+  if(p->rqnext == 0)
+    q->tail = p;
+  q->n++;
+}
+
+static struct proc*
+fairdequeue(struct runq *q)
+{
+  struct proc *p;
+
+  if((p = rrdequeue(q)) != 0 && BEFORE(q->vmin, p->vruntime))
+    q->vmin = p->vruntime;
+  return p;
+}
+
+static int
+fairtick(struct proc *p)
+{
+  p->vruntime += (1024 << 10) / weight[p->nice - NICEMIN];
+  return ++p->used >= p->slice;
+}
+
+struct schedpolicy fairpolicy = {
+  "fair share",
+  fairenqueue,
+  fairdequeue,
+  fairtick,
+};
+
+struct schedpolicy *schedpolicy = &fairpolicy;
@@ -0,0 +1,158 @@
+// Slab allocator for kernel objects smaller than a page.
+//
+// A slab is one page from kalloc(): a struct slab header
+// followed by as many objects as fit.  Free objects are kept
+// on a list threaded through the objects themselves.  A cache
+// keeps the slabs that still have free objects on its partial
+// list, and gives a slab's page back to kalloc() once all its
+// objects are free, unless it is the cache's only slab.
+//
+// In front of the slabs, each CPU has a magazine of up to
+// MAGSIZE free objects, used with interrupts off and no lock.
+// Magazines are refilled from, and drained to, the slabs half
+// a magazine at a time under the cache lock.
+
+#include "types.h"
+#include "defs.h"
+#include "param.h"
+#include "mmu.h"
+#include "x86.h"
+#include "proc.h"
+#include "spinlock.h"
+#include "slab.h"
+
+struct slab {
+  struct slab *next;     // partial list
+  struct slab *prev;
+  struct slabcache *c;
+  int inuse;             // objects handed out
+  void *free;            // first free object
+};
+
+void
+slabinit(struct slabcache *c, char *name, uint size)
+{
+  size = (size + 7) & ~7;
+  if(size < sizeof(void*) || size > PGSIZE - sizeof(struct slab))
+    panic("slabinit");
+  initlock(&c->lock, name);
+  c->name = name;
+  c->size = size;
+  c->partial = 0;
+  memset(c->mag, 0, sizeof(c->mag));
+}
+
+static void
+unlink(struct slabcache *c, struct slab *s)
+{
+  if(s->prev)
+    s->prev->next = s->next;
+  else
+    c->partial = s->next;
+  if(s->next)
+    s->next->prev = s->prev;
+}
+
+static void
+push(struct slabcache *c, struct slab *s)
+{
+  s->prev = 0;
+  s->next = c->partial;
+  if(c->partial)
+    c->partial->prev = s;
+  c->partial = s;
+}
+
+// Take one object from the slabs.  Caller holds c->lock.
+static void*
+slabget(struct slabcache *c)
+{
+  struct slab *s;
+  char *p, *obj;
+
+  if((s = c->partial) == 0){
+    if((s = (struct slab*)kalloc()) == 0)
+      return 0;
+    s->c = c;
+    s->inuse = 0;
+    s->free = 0;
+    p = (char*)s + ((sizeof(*s) + 7) & ~7);
+    for(; p + c->size <= (char*)s + PGSIZE; p += c->size){
+      *(void**)p = s->free;
+      s->free = p;
+    }
+    push(c, s);
+  }
+  obj = s->free;
+  s->free = *(void**)obj;
+  s->inuse++;
+  if(s->free == 0)
+    unlink(c, s);
+  return obj;
+}
+
+// Return one object to its slab.  Caller holds c->lock.
+static void
+slabput(struct slabcache *c, void *obj)
+{
+  struct slab *s;
+
+  s = (struct slab*)PGROUNDDOWN((uint)obj);
+  if(s->c != c)
+    panic("slabfree");
+  if(s->free == 0)
+    push(c, s);
+  *(void**)obj = s->free;
+  s->free = obj;
+  if(--s->inuse == 0 && (s->prev || s->next)){
+    unlink(c, s);
+    kfree((char*)s);
+  }
+}
+
+// Allocate a zeroed object from c.
+// Returns 0 if there is no memory.
+void*
+slaballoc(struct slabcache *c)
+{
+  void *obj;
+  int i;
+  struct magazine *m;
+
+  pushcli();
+  m = &c->mag[cpu - cpus];
+  if(m->n == 0){
+    acquire(&c->lock);
+    for(i = 0; i < MAGSIZE/2; i++){
+      if((obj = slabget(c)) == 0)
+        break;
+      m->obj[m->n++] = obj;
+    }
+    release(&c->lock);
+  }
+  obj = 0;
+  if(m->n > 0)
+    obj = m->obj[--m->n];
+  popcli();
+  if(obj)
+    memset(obj, 0, c->size);
+  return obj;
+}
+
+// Free an object allocated from c.
+void
+slabfree(struct slabcache *c, void *obj)
+{
+  struct magazine *m;
+
+  pushcli();
+  m = &c->mag[cpu - cpus];
+  if(m->n == MAGSIZE){
+    acquire(&c->lock);
+    while(m->n > MAGSIZE/2)
+      slabput(c, m->obj[--m->n]);
+    release(&c->lock);
+  }
+  m->obj[m->n++] = obj;
+  popcli();
+}
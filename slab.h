@@ -0,0 +1,17 @@
+// A cache of equally sized kernel objects, carved out of
+// pages from kalloc().  Each CPU keeps a magazine of free
+// objects so that most allocations take no lock.
+#define MAGSIZE 8
+
+struct magazine {
+  int n;
+  void *obj[MAGSIZE];
+};
+
+struct slabcache {
+  struct spinlock lock;
+  char *name;
+  uint size;             // object size, rounded up
+  struct slab *partial;  // slabs with at least one free object
+  struct magazine mag[NCPU];  // indexed like cpus[]
+};
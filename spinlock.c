@@ -8,13 +8,35 @@
 #include "mmu.h"
 #include "proc.h"
 #include "spinlock.h"
+#include "lockstat.h"
+
+// Locks that lockstat() reports: those in the kernel's own
+// data, which live forever.  Locks inside allocated memory,
+// such as each pipe's, come and go and are not tracked.
+static struct {
+  struct spinlock *lk[NLOCKSTAT];
+  int n;
+} locks;
+
+extern char end[]; // first address after kernel loaded from ELF file
 
 void
 initlock(struct spinlock *lk, char *name)
 {
+  int i;
+
   lk->name = name;
-  lk->locked = 0;
+  lk->next = 0;
+  lk->owner = 0;
   lk->cpu = 0;
+  lk->nacquire = 0;
+  lk->ncontend = 0;
+  lk->spin = 0;
+  if((char*)lk < end){
+    i = fetchadd(&locks.n, 1);
+    if(i < NLOCKSTAT)
+      locks.lk[i] = lk;
+  }
 }
 
 // Acquire the lock.
@@ -24,15 +46,27 @@ initlock(struct spinlock *lk, char *name)
 void
 acquire(struct spinlock *lk)
 {
+  uint ticket;
+  unsigned long long t0;
+
   pushcli(); // disable interrupts to avoid deadlock.
   if(holding(lk))
     panic("acquire");
 
-  // The xchg is atomic.
-  // It also serializes, so that reads after acquire are not
-  // reordered before it. 
-  while(xchg(&lk->locked, 1) != 0)
-    ;
+  // The locked xadd is atomic.  It also serializes, so
+  // that reads after acquire are not reordered before it.
+  // Each waiter spins reading only owner, which changes
+  // once per release.
+  ticket = fetchadd((volatile int*)&lk->next, 1);
+  if(lk->owner != ticket){
+    t0 = rdtsc();
+    while(lk->owner != ticket)
+      pause();
+    lk->ncontend++;
+    lk->spin += rdtsc() - t0;
+  }
+  __sync_synchronize();
+  lk->nacquire++;
 
   // Record info about lock acquisition for debugging.
   lk->cpu = cpu;
@@ -49,16 +83,12 @@ release(struct spinlock *lk)
   lk->pcs[0] = 0;
   lk->cpu = 0;
 
-  // The xchg serializes, so that reads before release are 
-  // not reordered after it.  The 1996 PentiumPro manual (Volume 3,
-  // 7.2) says reads can be carried out speculatively and in
-  // any order, which implies we need to serialize here.
-  // But the 2007 Intel 64 Architecture Memory Ordering White
-  // Paper says that Intel 64 and IA-32 will not move a load
-  // after a store. So lock->locked = 0 would work here.
-  // The xchg being asm volatile ensures gcc emits it after
-  // the above assignments (and after the critical section).
-  xchg(&lk->locked, 0);
+  // Serialize, so that reads and writes in the critical
+  // section are not moved after the release, by gcc or
+  // by the CPU.  Only the holder writes owner, so handing
+  // the lock to the next ticket needs no atomic operation.
+  __sync_synchronize();
+  lk->owner++;
 
   popcli();
 }
@@ -85,7 +115,26 @@ getcallerpcs(void *v, uint pcs[])
 int
 holding(struct spinlock *lock)
 {
-  return lock->locked && lock->cpu == cpu;
+  return lock->owner != lock->next && lock->cpu == cpu;
+}
+
+// Copy the contention statistics of up to n locks into ls.
+// Returns the number copied.  The counters are read without
+// the locks, so they are only a snapshot.
+int
+lockstat(struct lockstat *ls, int n)
+{
+  struct spinlock *lk;
+  int i;
+
+  for(i = 0; i < n && i < locks.n && i < NLOCKSTAT; i++){
+    lk = locks.lk[i];
+    safestrcpy(ls[i].name, lk->name, sizeof(ls[i].name));
+    ls[i].nacquire = lk->nacquire;
+    ls[i].ncontend = lk->ncontend;
+    ls[i].kspin = lk->spin >> 10;
+  }
+  return i;
 }
 
 
@@ -1,11 +1,19 @@
 // Mutual exclusion lock.
+// A ticket lock: each CPU takes the next ticket and waits
+// until owner reaches it, so waiters get the lock in the
+// order they arrived.
 struct spinlock {
-  uint locked;       // Is the lock held?
+  volatile uint next;   // Next ticket to hand out
+  volatile uint owner;  // Ticket that holds the lock
   
   // For debugging:
   char *name;        // Name of lock.
   struct cpu *cpu;   // The cpu holding the lock.
   uint pcs[10];      // The call stack (an array of program counters)
                      // that locked the lock.
-};
 
+  // Contention statistics, updated by the holder; see lockstat().
+  uint nacquire;     // Times acquired
+  uint ncontend;     // Times acquire() had to wait
+  unsigned long long spin;  // Cycles spent waiting
+};
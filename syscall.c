@@ -19,6 +19,8 @@ fetchint(struct proc *p, uint addr, int *ip)
 {
   if(addr >= p->sz || addr+4 > p->sz)
     return -1;
+  if(prefault(addr, 4, 0) < 0)
+    return -1;
   *ip = *(int*)(addr);
   return 0;
 }
@@ -35,9 +37,12 @@ fetchstr(struct proc *p, uint addr, char **pp)
     return -1;
   *pp = (char*)addr;
   ep = (char*)p->sz;
-  for(s = *pp; s < ep; s++)
+  for(s = *pp; s < ep; s++){
+    if((s == *pp || (uint)s % PGSIZE == 0) && prefault((uint)s, 1, 0) < 0)
+      return -1;
     if(*s == 0)
       return s - *pp;
+  }
   return -1;
 }
 
@@ -48,17 +53,32 @@ argint(int n, int *ip)
   return fetchint(proc, proc->tf->esp + 4 + 4*n, ip);
 }
 
+// Check that the n bytes at addr lie within the process
+// address space, either below proc->sz or inside one mmap()
+// region, and fault in any of their pages that are missing.
+// If write is set, the kernel is about to store into them.
+int
+checkrange(uint addr, uint n, int write)
+{
+  if(addr + n < addr)
+    return -1;
+  if((addr >= proc->sz || addr + n > proc->sz) && !mmapvalid(proc, addr, n))
+    return -1;
+  return prefault(addr, n, write);
+}
+
 // Fetch the nth word-sized system call argument as a pointer
 // to a block of memory of size n bytes.  Check that the pointer
-// lies within the process address space.
+// lies within the process address space.  If write is set,
+// the system call stores into the block.
 int
-argptr(int n, char **pp, int size)
+argptr(int n, char **pp, int size, int write)
 {
   int i;
 
   if(argint(n, &i) < 0)
     return -1;
-  if((uint)i >= proc->sz || (uint)i+size > proc->sz)
+  if(checkrange(i, size, write) < 0)
     return -1;
   *pp = (char*)i;
   return 0;
@@ -66,8 +86,10 @@ argptr(int n, char **pp, int size)
 
 // Fetch the nth word-sized system call argument as a string pointer.
 // Check that the pointer is valid and the string is nul-terminated.
-// (There is no shared writable memory, so the string can't change
-// between this check and being used by the kernel.)
+// (The only shared writable memory is in MAP_SHARED regions, which
+// lie above proc->sz where fetchstr() rejects the string, so the
+// string can't change between this check and being used by the
+// kernel.)
 int
 argstr(int n, char **pp)
 {
@@ -104,6 +126,22 @@ extern int sys_readlink(void);
 extern int sys_ftag(void);
 extern int sys_funtag(void);
 extern int sys_gettag(void);
+extern int sys_readdirplus(void);
+extern int sys_stat(void);
+extern int sys_fstatat(void);
+extern int sys_openat(void);
+extern int sys_pread(void);
+extern int sys_pwrite(void);
+extern int sys_lseek(void);
+extern int sys_readv(void);
+extern int sys_writev(void);
+extern int sys_splice(void);
+extern int sys_copy_file_range(void);
+extern int sys_mmap(void);
+extern int sys_munmap(void);
+extern int sys_setpriority(void);
+extern int sys_setaffinity(void);
+extern int sys_lockstat(void);
 
 
 
@@ -135,6 +173,22 @@ static int (*syscalls[])(void) = {
 [SYS_ftag]    sys_ftag,
 [SYS_funtag]  sys_funtag,
 [SYS_gettag]  sys_gettag,
+[SYS_readdirplus] sys_readdirplus,
+[SYS_stat]    sys_stat,
+[SYS_fstatat] sys_fstatat,
+[SYS_openat]  sys_openat,
+[SYS_pread]   sys_pread,
+[SYS_pwrite]  sys_pwrite,
+[SYS_lseek]   sys_lseek,
+[SYS_readv]   sys_readv,
+[SYS_writev]  sys_writev,
+[SYS_splice]  sys_splice,
+[SYS_copy_file_range] sys_copy_file_range,
+[SYS_mmap]    sys_mmap,
+[SYS_munmap]  sys_munmap,
+[SYS_setpriority] sys_setpriority,
+[SYS_setaffinity] sys_setaffinity,
+[SYS_lockstat] sys_lockstat,
 };
 
 void
@@ -27,3 +27,19 @@
 #define SYS_ftag 24
 #define SYS_funtag 25
 #define SYS_gettag 26
+#define SYS_readdirplus 27
+#define SYS_stat   28
+#define SYS_fstatat 29
+#define SYS_openat 30
+#define SYS_pread  31
+#define SYS_pwrite 32
+#define SYS_lseek  33
+#define SYS_readv  34
+#define SYS_writev 35
+#define SYS_splice 36
+#define SYS_copy_file_range 37
+#define SYS_mmap   38
+#define SYS_munmap 39
+#define SYS_setpriority 40
+#define SYS_setaffinity 41
+#define SYS_lockstat 42
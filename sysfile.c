@@ -7,6 +7,7 @@
 #include "types.h"
 #include "defs.h"
 #include "param.h"
+#include "memlayout.h"
 #include "stat.h"
 #include "mmu.h"
 #include "proc.h"
@@ -36,6 +37,32 @@ argfd(int n, int *pfd, struct file **pf)
   return 0;
 }
 
+// Fetch the nth system call argument as an array of cnt
+// iovecs, copying it into iov so that the file code never
+// rereads it from user memory, where a buffer being filled
+// or another process sharing the page could change it.
+// Check that each buffer lies within the process address
+// space.  If write is set, the system call stores into the
+// buffers.
+static int
+argiov(int n, int cnt, struct iovec *iov, int write)
+{
+  char *uiov;
+  int i;
+
+  if(cnt < 0 || cnt > MAXIOV)
+    return -1;
+  if(argptr(n, &uiov, cnt*sizeof(*iov), 0) < 0)
+    return -1;
+  memmove(iov, uiov, cnt*sizeof(*iov));
+  for(i = 0; i < cnt; i++){
+    if(iov[i].iov_len < 0 ||
+       checkrange((uint)iov[i].iov_base, iov[i].iov_len, write) < 0)
+      return -1;
+  }
+  return 0;
+}
+
 // Allocate a file descriptor for the given file.
 // Takes over file reference from caller on success.
 static int
@@ -73,11 +100,26 @@ sys_read(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n, 1) < 0)
     return -1;
   return fileread(f, p, n);
 }
 
+int
+sys_readdirplus(void)
+{
+  struct file *f;
+  int n;
+  struct direntplus *dp;
+
+  // Bound n first, so that n*sizeof(*dp) cannot wrap.
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || n < 0 ||
+     n > KERNBASE / sizeof(*dp) ||
+     argptr(1, (void*)&dp, n*sizeof(*dp), 1) < 0)
+    return -1;
+  return filereaddir(f, dp, n);
+}
+
 int
 sys_write(void)
 {
@@ -85,11 +127,118 @@ sys_write(void)
   int n;
   char *p;
 
-  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n) < 0)
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n, 0) < 0)
     return -1;
   return filewrite(f, p, n);
 }
 
+int
+sys_readv(void)
+{
+  struct file *f;
+  int cnt;
+  struct iovec iov[MAXIOV];
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov, 1) < 0)
+    return -1;
+  return filereadv(f, iov, cnt);
+}
+
+int
+sys_writev(void)
+{
+  struct file *f;
+  int cnt;
+  struct iovec iov[MAXIOV];
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &cnt) < 0 || argiov(1, cnt, iov, 0) < 0)
+    return -1;
+  return filewritev(f, iov, cnt);
+}
+
+int
+sys_mmap(void)
+{
+  struct file *f;
+  int off, len, prot, flags;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &len) < 0 ||
+     argint(3, &prot) < 0 || argint(4, &flags) < 0)
+    return -1;
+  return mmap(f, off, len, prot, flags);
+}
+
+int
+sys_munmap(void)
+{
+  int addr, len;
+
+  if(argint(0, &addr) < 0 || argint(1, &len) < 0)
+    return -1;
+  return munmap(addr, len);
+}
+
+int
+sys_splice(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0 ||
+     n < 0)
+    return -1;
+  return filesplice(in, out, n);
+}
+
+int
+sys_copy_file_range(void)
+{
+  struct file *in, *out;
+  int n;
+
+  if(argfd(0, 0, &in) < 0 || argfd(1, 0, &out) < 0 || argint(2, &n) < 0 ||
+     n < 0)
+    return -1;
+  return filecopy(in, out, n);
+}
+
+int
+sys_pread(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n, 1) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepread(f, p, n, off);
+}
+
+int
+sys_pwrite(void)
+{
+  struct file *f;
+  int n, off;
+  char *p;
+
+  if(argfd(0, 0, &f) < 0 || argint(2, &n) < 0 || argptr(1, &p, n, 0) < 0 ||
+     argint(3, &off) < 0 || off < 0)
+    return -1;
+  return filepwrite(f, p, n, off);
+}
+
+int
+sys_lseek(void)
+{
+  struct file *f;
+  int off, whence;
+
+  if(argfd(0, 0, &f) < 0 || argint(1, &off) < 0 || argint(2, &whence) < 0)
+    return -1;
+  return fileseek(f, off, whence);
+}
+
 int
 sys_close(void)
 {
@@ -109,11 +258,79 @@ sys_fstat(void)
   struct file *f;
   struct stat *st;
 
-  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st)) < 0)
+  if(argfd(0, 0, &f) < 0 || argptr(1, (void*)&st, sizeof(*st), 1) < 0)
     return -1;
   return filestat(f, st);
 }
 
+//A&T Follow the symlink chain starting at the locked inode ip,
+// up to 16 links.  Returns the locked target, or 0 (with ip
+// released) if the chain is broken or too long.
+static struct inode*
+derefi(struct inode *ip)
+{
+  struct inode *next;
+  int i;
+
+  for(i = 0; i < 16 && (ip->flags & I_SYMLNK); i++){
+    if((next = namei((char*)ip->addrs)) == 0){
+      iunlockput(ip);
+      return 0;
+    }
+    iunlockput(ip);
+    ip = next;
+    ilock(ip);
+  }
+  if(ip->flags & I_SYMLNK){
+    iunlockput(ip);
+    return 0;
+  }
+  return ip;
+}
+
+// Stat the file named by path, relative to dp (or the current
+// directory if dp is 0), following symlinks as open() does.
+static int
+statat(struct inode *dp, char *path, struct stat *st)
+{
+  struct inode *ip;
+
+  if((ip = nameiat(dp, path)) == 0)
+    return -1;
+  ilock(ip);
+  if((ip = derefi(ip)) == 0)
+    return -1;
+  stati(ip, st);
+  iunlockput(ip);
+  return 0;
+}
+
+int
+sys_stat(void)
+{
+  char *path;
+  struct stat *st;
+
+  if(argstr(0, &path) < 0 || argptr(1, (void*)&st, sizeof(*st), 1) < 0)
+    return -1;
+  return statat(0, path, st);
+}
+
+int
+sys_fstatat(void)
+{
+  struct file *f;
+  char *path;
+  struct stat *st;
+
+  if(argfd(0, 0, &f) < 0 || argstr(1, &path) < 0 ||
+     argptr(2, (void*)&st, sizeof(*st), 1) < 0)
+    return -1;
+  if(f->type != FD_INODE)
+    return -1;
+  return statat(f->ip, path, st);
+}
+
 // Create the path new as a link to the same inode as old.
 int
 sys_link(void)
@@ -234,14 +451,16 @@ bad:
   return -1;
 }
 
+// Create path, relative to directory at (or the current
+// directory if at is 0).
 static struct inode*
-create(char *path, short type, short major, short minor)
+create(struct inode *at, char *path, short type, short major, short minor)
 {
   uint off;
   struct inode *ip, *dp;
   char name[DIRSIZ];
 
-  if((dp = nameiparent(path, name)) == 0)
+  if((dp = nameiparentat(at, path, name)) == 0)
     return 0;
   ilock(dp);
 
@@ -279,26 +498,23 @@ create(char *path, short type, short major, short minor)
   return ip;
 }
 
-int
-sys_open(void)
+// Open path, relative to directory at (or the current
+// directory if at is 0), and return a new file descriptor.
+static int
+openi(struct inode *at, char *path, int omode)
 {
-  char *path;
-  int fd, omode;
+  int fd;
   struct file *f;
   struct inode *ip;
-  struct inode *sym_ip;
-  int i;
 
-  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
-    return -1;
   if(omode & O_CREATE){
     begin_trans();
-    ip = create(path, T_FILE, 0, 0);
+    ip = create(at, path, T_FILE, 0, 0);
     commit_trans();
     if(ip == 0)
       return -1;
   } else {
-    if((ip = namei(path)) == 0)
+    if((ip = nameiat(at, path)) == 0)
       return -1;
     ilock(ip);
     if(ip->type == T_DIR && omode != O_RDONLY){
@@ -308,22 +524,8 @@ sys_open(void)
   }
 
   //A&T checks if symlink
-  for (i=0;i < 16 ; i++) { //prevents loops ,up to 16 chain links
-      if (ip->flags & I_SYMLNK) {
-          if((sym_ip = namei((char*)ip->addrs)) == 0) {
-              iunlock(ip);
-              return -1;
-          }
-          iunlock(ip);
-          ip = sym_ip;
-          ilock(ip);
-      } else
-          break;
-  }
-  if (i == 16) {
-      panic("symbolic link exceeds 16 links ");
-  }
-  //A&T - end
+  if((ip = derefi(ip)) == 0)
+    return -1;
 
   if((f = filealloc()) == 0 || (fd = fdalloc(f)) < 0){
     if(f)
@@ -341,6 +543,34 @@ sys_open(void)
   return fd;
 }
 
+int
+sys_open(void)
+{
+  char *path;
+  int omode;
+
+  if(argstr(0, &path) < 0 || argint(1, &omode) < 0)
+    return -1;
+  return openi(0, path, omode);
+}
+
+// Open name relative to the directory held by dirfd, so that
+// walking a tree costs one lookup per entry rather than a
+// walk from the root or current directory.
+int
+sys_openat(void)
+{
+  struct file *f;
+  char *path;
+  int omode;
+
+  if(argfd(0, 0, &f) < 0 || argstr(1, &path) < 0 || argint(2, &omode) < 0)
+    return -1;
+  if(f->type != FD_INODE)
+    return -1;
+  return openi(f->ip, path, omode);
+}
+
 int
 sys_mkdir(void)
 {
@@ -348,7 +578,7 @@ sys_mkdir(void)
   struct inode *ip;
 
   begin_trans();
-  if(argstr(0, &path) < 0 || (ip = create(path, T_DIR, 0, 0)) == 0){
+  if(argstr(0, &path) < 0 || (ip = create(0, path, T_DIR, 0, 0)) == 0){
     commit_trans();
     return -1;
   }
@@ -369,7 +599,7 @@ sys_mknod(void)
   if((len=argstr(0, &path)) < 0 ||
      argint(1, &major) < 0 ||
      argint(2, &minor) < 0 ||
-     (ip = create(path, T_DEV, major, minor)) == 0){
+     (ip = create(0, path, T_DEV, major, minor)) == 0){
     commit_trans();
     return -1;
   }
@@ -443,7 +673,7 @@ sys_pipe(void)
   struct file *rf, *wf;
   int fd0, fd1;
 
-  if(argptr(0, (void*)&fd, 2*sizeof(fd[0])) < 0)
+  if(argptr(0, (void*)&fd, 2*sizeof(fd[0]), 1) < 0)
     return -1;
   if(pipealloc(&rf, &wf) < 0)
     return -1;
@@ -473,7 +703,7 @@ sys_symlink(void)
     if(argstr(0, &target) < 0 || argstr(1, &path) < 0)
         return -1;
     begin_trans();
-    ip = create(path, T_FILE, 0, 0);
+    ip = create(0, path, T_FILE, 0, 0);
     commit_trans();
     if(ip == 0)
         return -1;
@@ -515,7 +745,8 @@ sys_readlink(void)
     struct inode *ip, *sym_ip;
     int i;
 
-    if(argstr(0, &path) < 0 || argstr(1, &buf) < 0  || argint(2, (int*)&bufsiz) < 0)
+    if(argstr(0, &path) < 0 || argint(2, (int*)&bufsiz) < 0 ||
+       argptr(1, &buf, bufsiz, 1) < 0)
         return -1;
 
     if((ip = namei(path)) == 0)
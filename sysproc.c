@@ -5,6 +5,7 @@
 #include "memlayout.h"
 #include "mmu.h"
 #include "proc.h"
+#include "lockstat.h"
 
 int
 sys_fork(void)
@@ -35,6 +36,43 @@ sys_kill(void)
   return kill(pid);
 }
 
+int
+sys_setpriority(void)
+{
+  int pid, nice;
+
+  if(argint(0, &pid) < 0 || argint(1, &nice) < 0)
+    return -1;
+  return setpriority(pid, nice);
+}
+
+int
+sys_setaffinity(void)
+{
+  int pid, mask;
+
+  if(argint(0, &pid) < 0 || argint(1, &mask) < 0)
+    return -1;
+  return setaffinity(pid, mask);
+}
+
+int
+sys_lockstat(void)
+{
+  struct lockstat *ls;
+  int n;
+
+  if(argint(1, &n) < 0 || n < 0)
+    return -1;
+  // No more than NLOCKSTAT records are copied, and a smaller
+  // n cannot make n*sizeof(*ls) wrap.
+  if(n > NLOCKSTAT)
+    n = NLOCKSTAT;
+  if(argptr(0, (void*)&ls, n*sizeof(*ls), 1) < 0)
+    return -1;
+  return lockstat(ls, n);
+}
+
 int
 sys_getpid(void)
 {
@@ -60,6 +60,10 @@ trap(struct trapframe *tf)
     ideintr();
     lapiceoi();
     break;
+  case T_IRQ0 + IRQ_WAKEUP:
+    // Work was queued for this CPU; scheduler() will find it.
+    lapiceoi();
+    break;
   case T_IRQ0 + IRQ_IDE+1:
     // Bochs generates spurious IDE1 interrupts.
     break;
@@ -78,6 +82,10 @@ trap(struct trapframe *tf)
     lapiceoi();
     break;
    
+  case T_PGFLT:
+    if(pagefault(rcr2(), tf->err) == 0)
+      break;
+    // Not a fault that can be resolved; treat as below.
   //PAGEBREAK: 13
   default:
     if(proc == 0 || (tf->cs&3) == 0){
@@ -100,9 +108,11 @@ trap(struct trapframe *tf)
   if(proc && proc->killed && (tf->cs&3) == DPL_USER)
     exit();
 
-  // Force process to give up CPU on clock tick.
+  // Force process to give up CPU on clock tick, once the
+  // scheduling policy says its time slice is used up.
   // If interrupts were on while locks held, would need to check nlock.
-  if(proc && proc->state == RUNNING && tf->trapno == T_IRQ0+IRQ_TIMER)
+  if(proc && proc->state == RUNNING && tf->trapno == T_IRQ0+IRQ_TIMER &&
+     schedpolicy->tick(proc))
     yield();
 
   // Check if the process has been killed since we yielded
@@ -34,5 +34,6 @@
 #define IRQ_COM1         4
 #define IRQ_IDE         14
 #define IRQ_ERROR       19
+#define IRQ_WAKEUP      30      // IPI to wake an idle CPU
 #define IRQ_SPURIOUS    31
 
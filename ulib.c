@@ -4,6 +4,51 @@
 #include "user.h"
 #include "x86.h"
 
+// Raw system calls (usys.S), wrapped below.
+int _fork(void);
+int _exit(void) __attribute__((noreturn));
+int _close(int);
+int _exec(char*, char**);
+
+// Output buffered by printf.c must be written out before the
+// process goes away, is duplicated, or replaces its image, and
+// before its fd is closed.  Programs that do not link printf.o
+// (_forktest) leave these undefined, hence weak.
+void fflush(int) __attribute__((weak));
+void bufclose(int) __attribute__((weak));
+
+int
+fork(void)
+{
+  if(fflush)
+    fflush(-1);
+  return _fork();
+}
+
+int
+exit(void)
+{
+  if(fflush)
+    fflush(-1);
+  _exit();
+}
+
+int
+close(int fd)
+{
+  if(bufclose)
+    bufclose(fd);
+  return _close(fd);
+}
+
+int
+exec(char *path, char **argv)
+{
+  if(fflush)
+    fflush(-1);
+  return _exec(path, argv);
+}
+
 char*
 strcpy(char *s, char *t)
 {
@@ -67,20 +112,6 @@ gets(char *buf, int max)
   return buf;
 }
 
-int
-stat(char *n, struct stat *st)
-{
-  int fd;
-  int r;
-
-  fd = open(n, O_RDONLY);
-  if(fd < 0)
-    return -1;
-  r = fstat(fd, st);
-  close(fd);
-  return r;
-}
-
 int
 atoi(const char *s)
 {
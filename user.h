@@ -1,4 +1,7 @@
 struct stat;
+struct direntplus;
+struct iovec;
+struct lockstat;
 
 // system calls
 int fork(void);
@@ -28,14 +31,31 @@ int readlink(char*, char*, uint);
 int ftag(int, char*, char*);
 int funtag(int, char*);
 int gettag(int, char*, char*);
+int readdirplus(int, struct direntplus*, int);
+int stat(char*, struct stat*);
+int fstatat(int, char*, struct stat*);
+int openat(int, char*, int);
+int pread(int, void*, int, int);
+int pwrite(int, void*, int, int);
+int lseek(int, int, int);
+int readv(int, struct iovec*, int);
+int writev(int, struct iovec*, int);
+int splice(int, int, int);
+int copy_file_range(int, int, int);
+void* mmap(int, int, int, int, int);
+int munmap(void*, int);
+int setpriority(int, int);
+int setaffinity(int, uint);
+int lockstat(struct lockstat*, int);
 
 // ulib.c
-int stat(char*, struct stat*);
 char* strcpy(char*, char*);
 void *memmove(void*, void*, int);
 char* strchr(const char*, char c);
 int strcmp(const char*, const char*);
 void printf(int, char*, ...);
+void fflush(int);
+void bufclose(int);
 char* gets(char*, int max);
 uint strlen(char*);
 void* memset(void*, int, uint);
@@ -7,6 +7,7 @@
 #include "syscall.h"
 #include "traps.h"
 #include "memlayout.h"
+#include "lockstat.h"
 
 char buf[8192];
 char name[3];
@@ -200,6 +201,56 @@ exectest(void)
   }
 }
 
+// a program's file cannot be written while it runs, and
+// can be again once it has exited
+void
+textbusytest(void)
+{
+  int fd, fd1, pid;
+  char c;
+  char *argv[] = { "echotb", 0 };
+
+  printf(stdout, "text busy test\n");
+
+  fd = open("usertests", O_RDWR);
+  if(fd < 0 || pread(fd, &c, 1, 0) != 1){
+    printf(stdout, "open usertests failed\n");
+    exit();
+  }
+  if(pwrite(fd, &c, 1, 0) != -1){
+    printf(stdout, "write to running program succeeded\n");
+    exit();
+  }
+  if(mmap(fd, 0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED) != (char*)-1){
+    printf(stdout, "shared writable mmap of running program succeeded\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("echo", 0);
+  fd1 = open("echotb", O_CREATE|O_RDWR);
+  if(fd < 0 || fd1 < 0 || copy_file_range(fd, fd1, 100000) <= 0){
+    printf(stdout, "copy echo failed\n");
+    exit();
+  }
+  close(fd);
+  pid = fork();
+  if(pid == 0){
+    close(1);
+    exec("echotb", argv);
+    exit();
+  }
+  wait();
+  if(pwrite(fd1, "x", 1, 0) != 1){
+    printf(stdout, "write to exited program failed\n");
+    exit();
+  }
+  close(fd1);
+  unlink("echotb");
+
+  printf(stdout, "text busy ok\n");
+}
+
 // simple fork and pipe read/write
 
 void
@@ -254,6 +305,59 @@ pipe1(void)
   printf(1, "pipe1 ok\n");
 }
 
+// writes larger than the pipe ring, read back in odd-sized
+// pieces so that copies straddle the point where it wraps
+void
+pipe2(void)
+{
+  int fds[2], pid;
+  int seq, i, n, cc, total;
+
+  printf(1, "pipe2 test\n");
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  seq = 0;
+  if(pid == 0){
+    close(fds[0]);
+    for(n = 0; n < 12; n++){
+      for(i = 0; i < 7001; i++)
+        buf[i] = seq++;
+      if(write(fds[1], buf, 7001) != 7001){
+        printf(1, "pipe2 oops 1\n");
+        exit();
+      }
+    }
+    exit();
+  } else if(pid > 0){
+    close(fds[1]);
+    total = 0;
+    cc = 1;
+    while((n = read(fds[0], buf, cc)) > 0){
+      for(i = 0; i < n; i++){
+        if((buf[i] & 0xff) != (seq++ & 0xff)){
+          printf(1, "pipe2 oops 2\n");
+          exit();
+        }
+      }
+      total += n;
+      cc = cc * 3 % 3001 + 1;
+    }
+    if(total != 12 * 7001){
+      printf(1, "pipe2 oops 3 total %d\n", total);
+      exit();
+    }
+    close(fds[0]);
+    wait();
+  } else {
+    printf(1, "fork() failed\n");
+    exit();
+  }
+  printf(1, "pipe2 ok\n");
+}
+
 // meant to be run w/ at most two CPUs
 void
 preempt(void)
@@ -1241,6 +1345,1038 @@ dirfile(void)
   printf(1, "dir vs file OK\n");
 }
 
+// readdirplus returns every entry with the same stat as fstat
+void
+readdirplustest(void)
+{
+  int fd, i, n, nent, nfile;
+  struct direntplus de[2];
+
+  printf(1, "readdirplus test\n");
+
+  if(mkdir("rdp") != 0){
+    printf(1, "mkdir rdp failed\n");
+    exit();
+  }
+  fd = open("rdp/f", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "0123456789", 10) != 10){
+    printf(1, "create rdp/f failed\n");
+    exit();
+  }
+  close(fd);
+  if(mkdir("rdp/d") != 0){
+    printf(1, "mkdir rdp/d failed\n");
+    exit();
+  }
+
+  fd = open("rdp", 0);
+  nent = nfile = 0;
+  while((n = readdirplus(fd, de, 2)) > 0){
+    for(i = 0; i < n; i++){
+      nent++;
+      if(de[i].name[0] == 'f'){
+        if(de[i].st.type != T_FILE || de[i].st.size != 10){
+          printf(1, "readdirplus rdp/f wrong stat\n");
+          exit();
+        }
+        nfile++;
+      }
+      if(de[i].name[0] == 'd' && de[i].st.type != T_DIR){
+        printf(1, "readdirplus rdp/d wrong type\n");
+        exit();
+      }
+    }
+  }
+  close(fd);
+  if(n < 0 || nent != 4 || nfile != 1){
+    printf(1, "readdirplus wrong entries %d %d\n", nent, nfile);
+    exit();
+  }
+
+  fd = open("rdp/f", 0);
+  if(readdirplus(fd, de, 2) >= 0){
+    printf(1, "readdirplus on a file succeeded!\n");
+    exit();
+  }
+  close(fd);
+
+  if(unlink("rdp/d") != 0 || unlink("rdp/f") != 0 || unlink("rdp") != 0){
+    printf(1, "unlink rdp failed\n");
+    exit();
+  }
+
+  printf(1, "readdirplus ok\n");
+}
+
+// stat and fstatat by path, without opening the file
+void
+stattest(void)
+{
+  int fd, dfd;
+  struct stat st, st1;
+
+  printf(1, "stat test\n");
+
+  if(mkdir("sdir") != 0){
+    printf(1, "mkdir sdir failed\n");
+    exit();
+  }
+  fd = open("sdir/f", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "xyz", 3) != 3){
+    printf(1, "create sdir/f failed\n");
+    exit();
+  }
+  if(fstat(fd, &st1) < 0){
+    printf(1, "fstat sdir/f failed\n");
+    exit();
+  }
+  close(fd);
+
+  if(stat("sdir/f", &st) < 0 || st.ino != st1.ino || st.size != 3){
+    printf(1, "stat sdir/f wrong\n");
+    exit();
+  }
+  dfd = open("sdir", 0);
+  if(fstatat(dfd, "f", &st) < 0 || st.ino != st1.ino || st.size != 3){
+    printf(1, "fstatat sdir f wrong\n");
+    exit();
+  }
+  if(fstatat(dfd, "nonexistent", &st) >= 0){
+    printf(1, "fstatat nonexistent succeeded!\n");
+    exit();
+  }
+  close(dfd);
+  if(stat("sdir/nonexistent", &st) >= 0){
+    printf(1, "stat nonexistent succeeded!\n");
+    exit();
+  }
+
+  if(unlink("sdir/f") != 0 || unlink("sdir") != 0){
+    printf(1, "unlink sdir failed\n");
+    exit();
+  }
+
+  printf(1, "stat ok\n");
+}
+
+// openat resolves names relative to a directory fd
+void
+openattest(void)
+{
+  int dfd, fd;
+  char buf[4];
+
+  printf(1, "openat test\n");
+
+  if(mkdir("oat") != 0 || mkdir("oat/sub") != 0){
+    printf(1, "mkdir oat failed\n");
+    exit();
+  }
+  dfd = open("oat", 0);
+  if(dfd < 0){
+    printf(1, "open oat failed\n");
+    exit();
+  }
+  fd = openat(dfd, "sub/f", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "abc", 3) != 3){
+    printf(1, "openat create oat/sub/f failed\n");
+    exit();
+  }
+  close(fd);
+  fd = open("oat/sub/f", 0);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != 3 || buf[0] != 'a'){
+    printf(1, "open oat/sub/f after openat failed\n");
+    exit();
+  }
+  close(fd);
+  if(openat(dfd, "f", 0) >= 0){
+    printf(1, "openat oat f succeeded!\n");
+    exit();
+  }
+  fd = open("oat/sub/f", 0);
+  if(openat(fd, "x", 0) >= 0){
+    printf(1, "openat relative to a file succeeded!\n");
+    exit();
+  }
+  close(fd);
+  close(dfd);
+
+  if(unlink("oat/sub/f") != 0 || unlink("oat/sub") != 0 || unlink("oat") != 0){
+    printf(1, "unlink oat failed\n");
+    exit();
+  }
+
+  printf(1, "openat ok\n");
+}
+
+// pread/pwrite at explicit offsets leave the file offset alone;
+// lseek moves it
+void
+preadtest(void)
+{
+  int fd;
+  char buf[8];
+
+  printf(1, "pread test\n");
+
+  fd = open("preadf", O_CREATE|O_RDWR);
+  if(fd < 0 || write(fd, "0123456789", 10) != 10){
+    printf(1, "create preadf failed\n");
+    exit();
+  }
+  if(pread(fd, buf, 3, 4) != 3 || buf[0] != '4' || buf[2] != '6'){
+    printf(1, "pread preadf failed\n");
+    exit();
+  }
+  if(pwrite(fd, "ab", 2, 2) != 2){
+    printf(1, "pwrite preadf failed\n");
+    exit();
+  }
+  if(pwrite(fd, "ab", 2, 11) >= 0){
+    printf(1, "pwrite past end succeeded!\n");
+    exit();
+  }
+  // the offset is still at the end from the first write
+  if(read(fd, buf, sizeof(buf)) != 0){
+    printf(1, "pread/pwrite moved the offset\n");
+    exit();
+  }
+  if(lseek(fd, 0, SEEK_END) != 10 || lseek(fd, -9, SEEK_CUR) != 1){
+    printf(1, "lseek preadf failed\n");
+    exit();
+  }
+  if(read(fd, buf, 3) != 3 || buf[0] != '1' || buf[1] != 'a' || buf[2] != 'b'){
+    printf(1, "read after lseek failed\n");
+    exit();
+  }
+  if(lseek(fd, 11, SEEK_SET) >= 0 || lseek(fd, -1, SEEK_SET) >= 0){
+    printf(1, "lseek out of range succeeded!\n");
+    exit();
+  }
+  close(fd);
+  unlink("preadf");
+
+  printf(1, "pread ok\n");
+}
+
+// writev gathers several buffers, readv scatters them,
+// on a file and on a pipe
+void
+iovtest(void)
+{
+  int fd, fds[2], i;
+  struct iovec iov[3];
+  char a[4], b[600];
+
+  printf(1, "iov test\n");
+
+  memset(b, 'b', sizeof(b));
+  iov[0].iov_base = "aaaa";
+  iov[0].iov_len = 4;
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof(b);
+  iov[2].iov_base = "c";
+  iov[2].iov_len = 1;
+
+  fd = open("iovf", O_CREATE|O_RDWR);
+  if(fd < 0 || writev(fd, iov, 3) != 605){
+    printf(1, "writev iovf failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("iovf", 0);
+  memset(b, 0, sizeof(b));
+  iov[0].iov_base = a;
+  iov[1].iov_base = b;
+  if(readv(fd, iov, 2) != 604 || a[3] != 'a' || b[0] != 'b' || b[599] != 'b'){
+    printf(1, "readv iovf failed\n");
+    exit();
+  }
+  if(read(fd, a, sizeof(a)) != 1 || a[0] != 'c'){
+    printf(1, "readv iovf left wrong offset\n");
+    exit();
+  }
+  close(fd);
+
+  // A buffer that overlaps the iov array itself changes the
+  // user's copy of later entries, not the kernel's.
+  fd = open("iovf", 0);
+  memset(b, 0, sizeof(b));
+  iov[0].iov_base = iov;
+  iov[0].iov_len = sizeof(iov);
+  iov[1].iov_base = b;
+  iov[1].iov_len = 10;
+  if(readv(fd, iov, 2) != sizeof(iov) + 10 || b[9] != 'b'){
+    printf(1, "readv into iov array failed\n");
+    exit();
+  }
+  close(fd);
+  unlink("iovf");
+
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  iov[0].iov_base = "xy";
+  iov[0].iov_len = 2;
+  iov[1].iov_base = "z";
+  iov[1].iov_len = 1;
+  if(writev(fds[1], iov, 2) != 3){
+    printf(1, "writev pipe failed\n");
+    exit();
+  }
+  close(fds[1]);
+  iov[0].iov_base = a;
+  iov[0].iov_len = 1;
+  iov[1].iov_base = b;
+  iov[1].iov_len = sizeof(b);
+  i = readv(fds[0], iov, 2);
+  if(i != 3 || a[0] != 'x' || b[0] != 'y' || b[1] != 'z'){
+    printf(1, "readv pipe failed %d\n", i);
+    exit();
+  }
+  close(fds[0]);
+
+  printf(1, "iov ok\n");
+}
+
+// splice a file into a pipe in one process and the pipe
+// back out into another file in the other
+void
+splicetest(void)
+{
+  int fd, fd1, fds[2], i, n, pid, total;
+
+  printf(1, "splice test\n");
+
+  fd = open("splicef", O_CREATE|O_RDWR);
+  for(i = 0; i < 5000; i++)
+    buf[i] = i;
+  if(fd < 0 || write(fd, buf, 5000) != 5000){
+    printf(1, "write splicef failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("splicef", 0);
+  fd1 = open("splice2", O_CREATE|O_RDWR);
+  if(fd < 0 || fd1 < 0){
+    printf(1, "open splicef failed\n");
+    exit();
+  }
+  if(splice(fd, fd1, 10) != -1){
+    printf(1, "splice between files succeeded\n");
+    exit();
+  }
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[0]);
+    while((n = splice(fd, fds[1], 1000)) > 0)
+      ;
+    if(n < 0){
+      printf(1, "splice into pipe failed\n");
+      exit();
+    }
+    exit();
+  }
+  close(fds[1]);
+  total = 0;
+  while((n = splice(fds[0], fd1, 333)) > 0)
+    total += n;
+  wait();
+  if(n < 0 || total != 5000){
+    printf(1, "splice from pipe failed %d\n", total);
+    exit();
+  }
+  close(fds[0]);
+  close(fd);
+  close(fd1);
+
+  fd = open("splice2", 0);
+  memset(buf, 0, 5000);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != 5000){
+    printf(1, "read splice2 failed\n");
+    exit();
+  }
+  for(i = 0; i < 5000; i++){
+    if(buf[i] != (char)i){
+      printf(1, "splice2 wrong content\n");
+      exit();
+    }
+  }
+  close(fd);
+  unlink("splicef");
+  unlink("splice2");
+
+  printf(1, "splice ok\n");
+}
+
+// copy_file_range copies in the kernel and stops at the end
+// of the source
+void
+copytest(void)
+{
+  int fd, fd1, fds[2], i;
+
+  printf(1, "copy_file_range test\n");
+
+  fd = open("copyf", O_CREATE|O_RDWR);
+  for(i = 0; i < 6000; i++)
+    buf[i] = i * 7;
+  if(fd < 0 || write(fd, buf, 6000) != 6000){
+    printf(1, "write copyf failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("copyf", 0);
+  fd1 = open("copy2", O_CREATE|O_RDWR);
+  if(fd < 0 || fd1 < 0){
+    printf(1, "open copyf failed\n");
+    exit();
+  }
+  if(read(fd, buf, 100) != 100 || write(fd1, "x", 1) != 1){
+    printf(1, "copyf setup failed\n");
+    exit();
+  }
+  if((i = copy_file_range(fd, fd1, 10000)) != 5900){
+    printf(1, "copy_file_range returned %d\n", i);
+    exit();
+  }
+  if(copy_file_range(fd, fd1, 10) != 0){
+    printf(1, "copy_file_range past end failed\n");
+    exit();
+  }
+  if(copy_file_range(fd, fd1, 0) != 0){
+    printf(1, "copy_file_range of nothing failed\n");
+    exit();
+  }
+  if(pipe(fds) != 0){
+    printf(1, "pipe() failed\n");
+    exit();
+  }
+  if(copy_file_range(fds[0], fd1, 10) != -1){
+    printf(1, "copy_file_range from pipe succeeded\n");
+    exit();
+  }
+  close(fds[0]);
+  close(fds[1]);
+  // A failed write leaves the source offset where it was.
+  if((i = open("usertests", O_RDWR)) < 0 || lseek(fd, 0, SEEK_SET) != 0 ||
+     copy_file_range(fd, i, 100) != -1 || lseek(fd, 0, SEEK_CUR) != 0){
+    printf(1, "copy_file_range failed write moved source\n");
+    exit();
+  }
+  close(i);
+  close(fd);
+  close(fd1);
+
+  fd = open("copy2", 0);
+  memset(buf, 0, 6000);
+  if(fd < 0 || read(fd, buf, sizeof(buf)) != 5901 || buf[0] != 'x'){
+    printf(1, "read copy2 failed\n");
+    exit();
+  }
+  for(i = 100; i < 6000; i++){
+    if(buf[i - 99] != (char)(i * 7)){
+      printf(1, "copy2 wrong content\n");
+      exit();
+    }
+  }
+  close(fd);
+  unlink("copyf");
+  unlink("copy2");
+
+  printf(1, "copy_file_range ok\n");
+}
+
+// mmap a file: pages are read on first touch, private writes
+// stay private, shared writes reach the file at munmap
+void
+mmaptest(void)
+{
+  int fd, i, pid;
+  char *p;
+
+  printf(1, "mmap test\n");
+
+  fd = open("mmapf", O_CREATE|O_RDWR);
+  for(i = 0; i < 6000; i++)
+    buf[i] = 'a' + i % 26;
+  if(fd < 0 || write(fd, buf, 6000) != 6000){
+    printf(1, "write mmapf failed\n");
+    exit();
+  }
+
+  p = mmap(fd, 0, 6000, PROT_READ|PROT_WRITE, MAP_PRIVATE);
+  if(p == (char*)-1){
+    printf(1, "mmap private failed\n");
+    exit();
+  }
+  for(i = 0; i < 6000; i++){
+    if(p[i] != 'a' + i % 26){
+      printf(1, "mmap private wrong content at %d\n", i);
+      exit();
+    }
+  }
+  for(i = 6000; i < 8192; i++){
+    if(p[i] != 0){
+      printf(1, "mmap past end of file not zero\n");
+      exit();
+    }
+  }
+  p[0] = 'X';
+  pid = fork();
+  if(pid == 0){
+    if(p[0] != 'X' || p[5000] != 'a' + 5000 % 26){
+      printf(1, "mmap not inherited\n");
+      exit();
+    }
+    exit();
+  }
+  wait();
+  if(munmap(p, 6000) != 0){
+    printf(1, "munmap private failed\n");
+    exit();
+  }
+
+  p = mmap(fd, 4096, 1904, PROT_READ|PROT_WRITE, MAP_SHARED);
+  if(p == (char*)-1){
+    printf(1, "mmap shared failed\n");
+    exit();
+  }
+  if(p[0] != 'a' + 4096 % 26){
+    printf(1, "mmap at offset wrong content\n");
+    exit();
+  }
+  p[1] = 'Y';
+  // A mapped buffer can be passed to a system call.
+  if(pwrite(fd, p, 2, 0) != 2){
+    printf(1, "pwrite from mmap failed\n");
+    exit();
+  }
+  if(munmap(p, 1904) != 0){
+    printf(1, "munmap shared failed\n");
+    exit();
+  }
+  close(fd);
+
+  fd = open("mmapf", 0);
+  if(read(fd, buf, sizeof(buf)) != 6000){
+    printf(1, "mmap changed file size\n");
+    exit();
+  }
+  if(buf[0] != 'a' + 4096 % 26 || buf[1] != 'Y' || buf[4096] != buf[0] ||
+     buf[4097] != 'Y'){
+    printf(1, "mmap shared write lost\n");
+    exit();
+  }
+  if(mmap(fd, 0, 100, PROT_READ|PROT_WRITE, MAP_SHARED) != (char*)-1){
+    printf(1, "mmap shared writable of read-only fd succeeded\n");
+    exit();
+  }
+  close(fd);
+  unlink("mmapf");
+
+  printf(1, "mmap ok\n");
+}
+
+// Shared mappings of a file see each other's stores, and
+// write() to the file, at once.  Writing a page back when it
+// is unmapped must not undo a write() to other bytes of it.
+void
+mmapsharedtest(void)
+{
+  int fd, i, pid, fds[2];
+  char *p, *q, *r, c;
+
+  printf(1, "mmap shared test\n");
+
+  fd = open("mmapsf", O_CREATE|O_RDWR);
+  memset(buf, 'a', 4096);
+  if(fd < 0 || write(fd, buf, 4096) != 4096){
+    printf(1, "write mmapsf failed\n");
+    exit();
+  }
+  p = mmap(fd, 0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED);
+  q = mmap(fd, 0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED);
+  if(p == (char*)-1 || q == (char*)-1){
+    printf(1, "mmap shared failed\n");
+    exit();
+  }
+  if(q[10] != 'a'){
+    printf(1, "mmap shared wrong content\n");
+    exit();
+  }
+  p[10] = 'C';
+  if(q[10] != 'C'){
+    printf(1, "mmap shared store not seen by second mapping\n");
+    exit();
+  }
+
+  if(pipe(fds) != 0){
+    printf(1, "pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid == 0){
+    r = mmap(fd, 0, 4096, PROT_READ|PROT_WRITE, MAP_SHARED);
+    if(r == (char*)-1 || r[10] != 'C'){
+      printf(1, "mmap shared store not seen by other process\n");
+      exit();
+    }
+    r[200] = 'K';
+    write(fds[1], "x", 1);
+    read(fds[0], &c, 1);
+    exit();
+  }
+  if(read(fds[0], &c, 1) != 1 || p[200] != 'K'){
+    printf(1, "mmap shared store of other process not seen\n");
+    exit();
+  }
+  write(fds[1], "x", 1);
+  wait();
+  close(fds[0]);
+  close(fds[1]);
+
+  if(pwrite(fd, "W", 1, 100) != 1 || p[100] != 'W'){
+    printf(1, "mmap shared does not see pwrite\n");
+    exit();
+  }
+  // Another process could change a string in a shared page
+  // while the kernel uses it, so system calls refuse one.
+  p[12] = 0;
+  if(open(p + 10, O_CREATE|O_RDWR) != -1){
+    printf(1, "open of a path in shared memory succeeded\n");
+    exit();
+  }
+  p[12] = 'a';
+  p[0] = 'D';
+  if(munmap(p, 4096) != 0 || munmap(q, 4096) != 0){
+    printf(1, "munmap shared failed\n");
+    exit();
+  }
+  if(pread(fd, buf, 4096, 0) != 4096){
+    printf(1, "read mmapsf failed\n");
+    exit();
+  }
+  for(i = 0; i < 4096; i++){
+    c = 'a';
+    if(i == 0)
+      c = 'D';
+    else if(i == 10)
+      c = 'C';
+    else if(i == 100)
+      c = 'W';
+    else if(i == 200)
+      c = 'K';
+    if(buf[i] != c){
+      printf(1, "mmap shared wrong file content at %d\n", i);
+      exit();
+    }
+  }
+  close(fd);
+  unlink("mmapsf");
+
+  printf(1, "mmap shared ok\n");
+}
+
+// fork shares memory copy-on-write: three children of an
+// 80MB process fit in memory, and each child's writes stay
+// its own, including those the kernel makes for read()
+void
+cowtest(void)
+{
+  int i, n, pid, fds[2];
+  char *a, *oldbrk;
+  uint sz;
+
+  printf(1, "cow test\n");
+
+  sz = 80*1024*1024;
+  oldbrk = sbrk(0);
+  a = sbrk(sz);
+  if(a == (char*)-1){
+    printf(1, "cow sbrk failed\n");
+    exit();
+  }
+  for(i = 0; i < sz; i += 4096)
+    a[i] = i / 4096;
+
+  for(n = 0; n < 3; n++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "cow fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      for(i = n * 4096; i < sz; i += 4 * 4096)
+        a[i] = 'A' + n;
+      for(i = n * 4096; i < sz; i += 4 * 4096){
+        if(a[i] != 'A' + n){
+          printf(1, "cow child lost its write\n");
+          exit();
+        }
+      }
+      exit();
+    }
+  }
+  for(n = 0; n < 3; n++)
+    wait();
+
+  // A child reads from a pipe into shared pages.
+  if(pipe(fds) != 0){
+    printf(1, "cow pipe failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "cow fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    close(fds[1]);
+    for(n = 0; n < 8192; n += i){
+      if((i = read(fds[0], a + 4096 + n, 8192 - n)) <= 0){
+        printf(1, "cow read failed\n");
+        exit();
+      }
+    }
+    if(a[4096] != 'r' || a[3*4096 - 1] != 'r'){
+      printf(1, "cow read lost\n");
+      exit();
+    }
+    exit();
+  }
+  close(fds[0]);
+  memset(buf, 'r', 8192);
+  if(write(fds[1], buf, 8192) != 8192){
+    printf(1, "cow write failed\n");
+    exit();
+  }
+  close(fds[1]);
+  wait();
+
+  for(i = 0; i < sz; i += 4096){
+    if(a[i] != (char)(i / 4096)){
+      printf(1, "cow child write reached parent\n");
+      exit();
+    }
+  }
+  sbrk(-(sbrk(0) - oldbrk));
+
+  printf(1, "cow ok\n");
+}
+
+// sbrk only reserves memory: more than the machine has can
+// be reserved, and pages appear zeroed when first touched,
+// including by the kernel
+void
+lazytest(void)
+{
+  int fd, pid;
+  char *a, *oldbrk;
+  uint sz;
+
+  printf(1, "lazy sbrk test\n");
+
+  sz = 300*1024*1024;
+  oldbrk = sbrk(0);
+  a = sbrk(sz);
+  if(a == (char*)-1){
+    printf(1, "lazy sbrk failed\n");
+    exit();
+  }
+  if(a[0] != 0 || a[sz/2] != 0 || a[sz-1] != 0){
+    printf(1, "lazy page not zero\n");
+    exit();
+  }
+  a[sz-1] = 'z';
+
+  fd = open("README", 0);
+  if(fd < 0 || read(fd, a + sz/3, 100) != 100){
+    printf(1, "read into lazy page failed\n");
+    exit();
+  }
+  close(fd);
+
+  pid = fork();
+  if(pid < 0){
+    printf(1, "lazy fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(a[sz-1] != 'z' || a[sz/4] != 0){
+      printf(1, "lazy fork wrong content\n");
+      exit();
+    }
+    exit();
+  }
+  wait();
+  sbrk(-(sbrk(0) - oldbrk));
+
+  // Shrinking to the middle of a 4MB region that has no page
+  // table must still free the first page of the next region.
+  a = (char*)(((uint)oldbrk + 12*1024*1024) & ~(4*1024*1024 - 1));
+  sbrk(a + 4096 - oldbrk);
+  a[0] = 'x';
+  sbrk(a - 4*1024*1024 + 8192 - sbrk(0));
+  sbrk(a + 4096 - sbrk(0));
+  if(a[0] != 0){
+    printf(1, "lazy sbrk shrink left a page mapped\n");
+    exit();
+  }
+  sbrk(-(sbrk(0) - oldbrk));
+
+  printf(1, "lazy sbrk ok\n");
+}
+
+// private mappings of a file share cached pages: a write
+// through one mapping must not show in another, and writing
+// the file must not leave stale pages behind
+void
+pcachetest(void)
+{
+  int fd, i;
+  char *p, *q;
+
+  printf(1, "page cache test\n");
+
+  fd = open("pcachef", O_CREATE|O_RDWR);
+  memset(buf, 'a', 8192);
+  if(fd < 0 || write(fd, buf, 8192) != 8192){
+    printf(1, "write pcachef failed\n");
+    exit();
+  }
+  p = mmap(fd, 0, 8192, PROT_READ|PROT_WRITE, MAP_PRIVATE);
+  q = mmap(fd, 0, 8192, PROT_READ|PROT_WRITE, MAP_PRIVATE);
+  if(p == (char*)-1 || q == (char*)-1 || p == q){
+    printf(1, "mmap pcachef failed\n");
+    exit();
+  }
+  if(p[100] != 'a' || q[100] != 'a'){
+    printf(1, "pcache wrong content\n");
+    exit();
+  }
+  p[100] = 'b';
+  if(q[100] != 'a'){
+    printf(1, "pcache private write leaked\n");
+    exit();
+  }
+  munmap(q, 8192);
+
+  if(pwrite(fd, "c", 1, 200) != 1){
+    printf(1, "pwrite pcachef failed\n");
+    exit();
+  }
+  q = mmap(fd, 0, 8192, PROT_READ, MAP_PRIVATE);
+  if(q == (char*)-1 || q[200] != 'c'){
+    printf(1, "pcache stale after write\n");
+    exit();
+  }
+  for(i = 0; i < 8192; i += 4096){
+    if(q[i] != 'a'){
+      printf(1, "pcache wrong content\n");
+      exit();
+    }
+  }
+  munmap(p, 8192);
+  munmap(q, 8192);
+  close(fd);
+  unlink("pcachef");
+
+  printf(1, "page cache ok\n");
+}
+
+// more open files, all at once, than the old fixed file
+// table (NFILE 100) could hold.
+void
+ftabletest(void)
+{
+  int i, j, pid, fd, p[2], q[2];
+  char c;
+
+  printf(1, "file table test\n");
+
+  fd = open("ftablef", O_CREATE|O_RDWR);
+  if(fd < 0){
+    printf(1, "create ftablef failed\n");
+    exit();
+  }
+  close(fd);
+  if(pipe(p) != 0 || pipe(q) != 0){
+    printf(1, "pipe failed\n");
+    exit();
+  }
+  for(i = 0; i < 12; i++){
+    pid = fork();
+    if(pid < 0){
+      printf(1, "fork failed\n");
+      exit();
+    }
+    if(pid == 0){
+      close(p[0]);
+      close(q[1]);
+      for(j = 0; j < 11; j++){
+        if(open("ftablef", O_RDONLY) < 0){
+          printf(1, "open ftablef failed\n");
+          exit();
+        }
+      }
+      write(p[1], "x", 1);
+      read(q[0], &c, 1);
+      exit();
+    }
+  }
+  close(p[1]);
+  close(q[0]);
+  for(i = 0; i < 12; i++){
+    if(read(p[0], &c, 1) != 1){
+      printf(1, "file table full\n");
+      exit();
+    }
+  }
+  close(q[1]);
+  close(p[0]);
+  for(i = 0; i < 12; i++)
+    wait();
+  unlink("ftablef");
+
+  printf(1, "file table ok\n");
+}
+
+// setpriority() checks its arguments, and a nice child
+// still runs to completion next to a busy parent.
+void
+nicetest(void)
+{
+  int pid, i;
+  volatile int x;
+
+  printf(1, "nice test\n");
+
+  if(setpriority(0, NICEMAX + 1) != -1 || setpriority(0, NICEMIN - 1) != -1){
+    printf(1, "setpriority accepted a bad nice value\n");
+    exit();
+  }
+  if(setpriority(1000000, 0) != -1){
+    printf(1, "setpriority accepted a bad pid\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0){
+    if(setpriority(0, NICEMAX) != 0){
+      printf(1, "setpriority failed\n");
+      exit();
+    }
+    for(x = 0; x < 1000000; x++)
+      ;
+    exit();
+  }
+  for(i = 0, x = 0; i < 1000000; i++)
+    x++;
+  if(wait() != pid){
+    printf(1, "wait wrong pid\n");
+    exit();
+  }
+  if(setpriority(0, 0) != 0){
+    printf(1, "setpriority failed\n");
+    exit();
+  }
+
+  printf(1, "nice ok\n");
+}
+
+// setaffinity() checks its mask, and processes pinned to
+// one CPU still run, fork and exit.
+void
+affinitytest(void)
+{
+  int pid;
+
+  printf(1, "affinity test\n");
+
+  if(setaffinity(0, 0) != -1){
+    printf(1, "setaffinity accepted an empty mask\n");
+    exit();
+  }
+  if(setaffinity(1000000, 1) != -1){
+    printf(1, "setaffinity accepted a bad pid\n");
+    exit();
+  }
+  if(setaffinity(0, 1) != 0){
+    printf(1, "setaffinity failed\n");
+    exit();
+  }
+  pid = fork();
+  if(pid < 0){
+    printf(1, "fork failed\n");
+    exit();
+  }
+  if(pid == 0)
+    exit();
+  if(wait() != pid){
+    printf(1, "wait wrong pid\n");
+    exit();
+  }
+  if(setaffinity(0, ~0) != 0){
+    printf(1, "setaffinity failed\n");
+    exit();
+  }
+
+  printf(1, "affinity ok\n");
+}
+
+// lockstat() reports the kernel's locks, and counts the
+// acquisitions that system calls make.
+void
+lockstattest(void)
+{
+  static struct lockstat ls[NLOCKSTAT];
+  int i, n;
+  uint before;
+
+  printf(1, "lockstat test\n");
+
+  n = lockstat(ls, NLOCKSTAT);
+  for(i = 0; i < n; i++)
+    if(strcmp(ls[i].name, "ftable") == 0)
+      break;
+  if(n <= 0 || i == n){
+    printf(1, "lockstat: no ftable lock\n");
+    exit();
+  }
+  before = ls[i].nacquire;
+  close(dup(0));
+  if(lockstat(ls, NLOCKSTAT) != n || ls[i].nacquire == before){
+    printf(1, "lockstat: ftable acquisitions not counted\n");
+    exit();
+  }
+  if(lockstat(ls, -1) != -1){
+    printf(1, "lockstat accepted a negative count\n");
+    exit();
+  }
+  if(lockstat((struct lockstat*)(KERNBASE - 64), 0x924924a) != -1){
+    printf(1, "lockstat accepted a wrapping count\n");
+    exit();
+  }
+
+  printf(1, "lockstat ok\n");
+}
+
 // test that iput() is called at the end of _namei()
 void
 iref(void)
@@ -1249,7 +2385,7 @@ iref(void)
 
   printf(1, "empty file name\n");
 
-  // the 50 is NINODE
+  // the 50 was NINODE; the inode cache now grows as needed
   for(i = 0; i < 50 + 1; i++){
     if(mkdir("irefd") != 0){
       printf(1, "mkdir irefd failed\n");
@@ -1630,6 +2766,7 @@ main(int argc, char *argv[])
 
   mem();
   pipe1();
+  pipe2();
   preempt();
   exitwait();
 
@@ -1645,10 +2782,27 @@ main(int argc, char *argv[])
   twofiles();
   sharedfd();
   dirfile();
+  readdirplustest();
+  stattest();
+  openattest();
+  preadtest();
+  iovtest();
+  splicetest();
+  copytest();
+  mmaptest();
+  mmapsharedtest();
+  cowtest();
+  lazytest();
+  pcachetest();
+  ftabletest();
+  nicetest();
+  affinitytest();
+  lockstattest();
   iref();
   forktest();
   bigdir(); // slow
 
+  textbusytest();
   exectest();
 
   exit();
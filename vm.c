@@ -42,7 +42,7 @@ seginit(void)
 // Return the address of the PTE in page table pgdir
 // that corresponds to virtual address va.  If alloc!=0,
 // create any required page table pages.
-static pte_t *
+pte_t *
 walkpgdir(pde_t *pgdir, const void *va, int alloc)
 {
   pde_t *pde;
@@ -52,10 +52,9 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
   if(*pde & PTE_P){
     pgtab = (pte_t*)p2v(PTE_ADDR(*pde));
   } else {
-    if(!alloc || (pgtab = (pte_t*)kalloc()) == 0)
-      return 0;
     // Make sure all those PTE_P bits are zero.
-    memset(pgtab, 0, PGSIZE);
+    if(!alloc || (pgtab = (pte_t*)kalloc_zeroed()) == 0)
+      return 0;
     // The permissions here are overly generous, but they can
     // be further restricted by the permissions in the page table 
     // entries, if necessary.
@@ -67,7 +66,7 @@ walkpgdir(pde_t *pgdir, const void *va, int alloc)
 // Create PTEs for virtual addresses starting at va that refer to
 // physical addresses starting at pa. va and size might not
 // be page-aligned.
-static int
+int
 mappages(pde_t *pgdir, void *va, uint size, uint pa, int perm)
 {
   char *a, *last;
@@ -131,9 +130,8 @@ setupkvm()
   pde_t *pgdir;
   struct kmap *k;
 
-  if((pgdir = (pde_t*)kalloc()) == 0)
+  if((pgdir = (pde_t*)kalloc_zeroed()) == 0)
     return 0;
-  memset(pgdir, 0, PGSIZE);
   if (p2v(PHYSTOP) > (void*)DEVSPACE)
     panic("PHYSTOP too high");
   for(k = kmap; k < &kmap[NELEM(kmap)]; k++)
@@ -185,36 +183,11 @@ inituvm(pde_t *pgdir, char *init, uint sz)
   
   if(sz >= PGSIZE)
     panic("inituvm: more than a page");
-  mem = kalloc();
-  memset(mem, 0, PGSIZE);
+  mem = kalloc_zeroed();
   mappages(pgdir, 0, PGSIZE, v2p(mem), PTE_W|PTE_U);
   memmove(mem, init, sz);
 }
 
-// Load a program segment into pgdir.  addr must be page-aligned
-// and the pages from addr to addr+sz must already be mapped.
-int
-loaduvm(pde_t *pgdir, char *addr, struct inode *ip, uint offset, uint sz)
-{
-  uint i, pa, n;
-  pte_t *pte;
-
-  if((uint) addr % PGSIZE != 0)
-    panic("loaduvm: addr must be page aligned");
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, addr+i, 0)) == 0)
-      panic("loaduvm: address should exist");
-    pa = PTE_ADDR(*pte);
-    if(sz - i < PGSIZE)
-      n = sz - i;
-    else
-      n = PGSIZE;
-    if(readi(ip, p2v(pa), offset+i, n) != n)
-      return -1;
-  }
-  return 0;
-}
-
 // Allocate page tables and physical memory to grow process from oldsz to
 // newsz, which need not be page aligned.  Returns new size or 0 on error.
 int
@@ -230,13 +203,12 @@ allocuvm(pde_t *pgdir, uint oldsz, uint newsz)
 
   a = PGROUNDUP(oldsz);
   for(; a < newsz; a += PGSIZE){
-    mem = kalloc();
+    mem = kalloc_zeroed();
     if(mem == 0){
       cprintf("allocuvm out of memory\n");
       deallocuvm(pgdir, newsz, oldsz);
       return 0;
     }
-    memset(mem, 0, PGSIZE);
     mappages(pgdir, (char*)a, PGSIZE, v2p(mem), PTE_W|PTE_U);
   }
   return newsz;
@@ -259,7 +231,7 @@ deallocuvm(pde_t *pgdir, uint oldsz, uint newsz)
   for(; a  < oldsz; a += PGSIZE){
     pte = walkpgdir(pgdir, (char*)a, 0);
     if(!pte)
-      a += (NPTENTRIES - 1) * PGSIZE;
+      a = PGADDR(PDX(a) + 1, 0, 0) - PGSIZE;
     else if((*pte & PTE_P) != 0){
       pa = PTE_ADDR(*pte);
       if(pa == 0)
@@ -305,28 +277,35 @@ clearpteu(pde_t *pgdir, char *uva)
 }
 
 // Given a parent process's page table, create a copy
-// of it for a child.
+// of it for a child.  The child shares every page that is
+// present below KERNBASE instead of getting a copy: writable
+// pages become read-only and copy-on-write in both page tables,
+// except MAP_SHARED pages, which stay shared and writable.
+// Pages that have not been faulted in yet stay that way in
+// the child.  The caller must flush the TLB for pgdir.
 pde_t*
-copyuvm(pde_t *pgdir, uint sz)
+copyuvm(pde_t *pgdir)
 {
   pde_t *d;
   pte_t *pte;
   uint pa, i;
-  char *mem;
 
   if((d = setupkvm()) == 0)
     return 0;
-  for(i = 0; i < sz; i += PGSIZE){
-    if((pte = walkpgdir(pgdir, (void *) i, 0)) == 0)
-      panic("copyuvm: pte should exist");
+  for(i = 0; i < KERNBASE; i += PGSIZE){
+    if(!(pgdir[PDX(i)] & PTE_P)){
+      i += (NPTENTRIES - 1) * PGSIZE;
+      continue;
+    }
+    pte = walkpgdir(pgdir, (void *) i, 0);
     if(!(*pte & PTE_P))
-      panic("copyuvm: page not present");
+      continue;
+    if((*pte & PTE_W) && !(*pte & PTE_SHARED))
+      *pte = (*pte & ~PTE_W) | PTE_COW;
     pa = PTE_ADDR(*pte);
-    if((mem = kalloc()) == 0)
-      goto bad;
-    memmove(mem, (char*)p2v(pa), PGSIZE);
-    if(mappages(d, (void*)i, PGSIZE, v2p(mem), PTE_W|PTE_U) < 0)
+    if(mappages(d, (void*)i, PGSIZE, pa, PTE_FLAGS(*pte)) < 0)
       goto bad;
+    kref(p2v(pa));
   }
   return d;
 
@@ -335,6 +314,91 @@ bad:
   return 0;
 }
 
+// Give pgdir its own writable copy of the copy-on-write page
+// that pte maps.  If no other page table still shares the
+// page, it is simply made writable again.
+static int
+cowpage(pte_t *pte)
+{
+  char *mem, *old;
+
+  old = p2v(PTE_ADDR(*pte));
+  if(krefcount(old) > 1){
+    if((mem = kalloc()) == 0)
+      return -1;
+    memmove(mem, old, PGSIZE);
+    *pte = v2p(mem) | PTE_FLAGS(*pte);
+    kfree(old);
+  }
+  *pte = (*pte & ~PTE_COW) | PTE_W;
+  return 0;
+}
+
+// Resolve a page fault at va in the current process.
+// Returns 0 if the access can be retried, -1 if the
+// address is not one the process may use that way.
+int
+pagefault(uint va, uint err)
+{
+  pte_t *pte;
+  struct vma *v;
+  char *mem;
+
+  if(proc == 0 || va >= KERNBASE)
+    return -1;
+  if((err & (FEC_PR|FEC_WR)) == (FEC_PR|FEC_WR)){
+    pte = walkpgdir(proc->pgdir, (char*)va, 0);
+    if(pte == 0 || !(*pte & PTE_COW) || cowpage(pte) < 0)
+      return -1;
+    lcr3(v2p(proc->pgdir));
+    return 0;
+  }
+  // A program segment that a shrinking heap has left
+  // above proc->sz is no longer part of the process.
+  if((v = findvma(proc, va)) != 0 && (va < proc->sz || v->addr >= proc->sz))
+    return mmapfault(proc, v, va, err);
+
+  // Heap pages below proc->sz are allocated, zeroed,
+  // on first touch; sbrk() only moves proc->sz.
+  if((err & FEC_PR) || va >= proc->sz)
+    return -1;
+  if((mem = kalloc_zeroed()) == 0)
+    return -1;
+  if(mappages(proc->pgdir, (char*)PGROUNDDOWN(va), PGSIZE, v2p(mem), PTE_W|PTE_U) < 0){
+    kfree(mem);
+    return -1;
+  }
+  return 0;
+}
+
+// Fault in any pages of [va, va+n) that are not present yet
+// and, if the kernel is going to write the buffer, give the
+// process its own copy of any copy-on-write page in it.
+// System calls do this before using a user buffer, since the
+// kernel may touch the buffer while holding a spinlock, when
+// the fault handler must not sleep reading the page, and so
+// that running out of memory, or writing a read-only page,
+// fails the call instead of faulting inside the kernel.
+int
+prefault(uint va, uint n, int write)
+{
+  uint a, err;
+  pte_t *pte;
+
+  err = write ? FEC_WR : 0;
+  for(a = PGROUNDDOWN(va); a < va + n; a += PGSIZE){
+    pte = walkpgdir(proc->pgdir, (char*)a, 0);
+    if(pte == 0 || !(*pte & PTE_P)){
+      if(pagefault(a, err) < 0)
+        return -1;
+    } else if(write && !(*pte & PTE_W)){
+      if(pagefault(a, FEC_PR|FEC_WR) < 0)
+        return -1;
+    }
+  }
+  return 0;
+}
+
 //PAGEBREAK!
 // Map user virtual address to kernel address.
 char*
@@ -353,15 +417,25 @@ uva2ka(pde_t *pgdir, char *uva)
 // Copy len bytes from p to user address va in page table pgdir.
 // Most useful when pgdir is not the current page table.
 // uva2ka ensures this only works for PTE_U pages.
+// Copy-on-write pages are copied first, since the kernel's
+// own mapping of the page would not fault.
 int
 copyout(pde_t *pgdir, uint va, void *p, uint len)
 {
   char *buf, *pa0;
   uint n, va0;
+  pte_t *pte;
 
   buf = (char*)p;
   while(len > 0){
     va0 = (uint)PGROUNDDOWN(va);
+    pte = walkpgdir(pgdir, (char*)va0, 0);
+    if(pte && (*pte & PTE_COW)){
+      if(cowpage(pte) < 0)
+        return -1;
+      if(proc && pgdir == proc->pgdir)
+        lcr3(v2p(pgdir));
+    }
     pa0 = uva2ka(pgdir, (char*)va0);
     if(pa0 == 0)
       return -1;
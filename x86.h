@@ -130,6 +130,34 @@ xchg(volatile uint *addr, uint newval)
   return result;
 }
 
+// Read the time-stamp counter.
+static inline unsigned long long
+rdtsc(void)
+{
+  unsigned long long val;
+
+  asm volatile("rdtsc" : "=A" (val));
+  return val;
+}
+
+// Tell the CPU it is in a spin loop.
+static inline void
+pause(void)
+{
+  asm volatile("pause");
+}
+
+// Atomically add n to *addr and return its old value.
+static inline int
+fetchadd(volatile int *addr, int n)
+{
+  asm volatile("lock; xaddl %0, %1" :
+               "+r" (n), "+m" (*addr) :
+               :
+               "cc");
+  return n;
+}
+
 static inline uint
 rcr2(void)
 {
@@ -144,6 +172,15 @@ lcr3(uint val)
   asm volatile("movl %0,%%cr3" : : "r" (val));
 }
 
+// Enable interrupts and wait for one.  sti takes effect only
+// after the next instruction, so no interrupt can arrive
+// between the two and leave the hlt waiting for another.
+static inline void
+stihlt(void)
+{
+  asm volatile("sti; hlt");
+}
+
 //PAGEBREAK: 36
 // Layout of the trap frame built on the stack by the
 // hardware and by trapasm.S, and passed to trap().